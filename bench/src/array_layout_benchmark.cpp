@@ -0,0 +1,156 @@
+// Compares the grid sweeps done by the solver on the two Array3D layouts.
+//
+// The entropy sweep is find_lowest_entropy's access pattern: every cell in
+// range2D order, reading all patterns of the cell. The neighbourhood sweep is
+// OverlappingModel::propagate's: for every cell, the pattern slice of every
+// cell in the surrounding (2n - 1) X (2n - 1) window.
+//
+// Pass "entropy" or "neighbourhood" and "row" or "x" to run a single case and
+// print what it sums to after its time, which is handy for `perf stat -e
+// cache-misses ./arrayLayoutBenchmark entropy x`.
+
+#include <wfc/algorithm_data.h>
+#include <wfc/arrays.h>
+#include <wfc/ranges.h>
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+const size_t kNumPatterns = 256;
+const int kN = 3;
+
+template <class Layout> Array3D<Bool, Layout> makeWave(size_t side) {
+  Array3D<Bool, Layout> wave({side, side, kNumPatterns}, true);
+  // Knock out some patterns so the sums depend on the data
+  for (size_t y = 0; y < side; ++y) {
+    for (size_t x = 0; x < side; ++x) {
+      wave[{x, y, (x * 7 + y * 13) % kNumPatterns}] = false;
+    }
+  }
+  return wave;
+}
+
+template <class Layout>
+double entropySweep(const Array3D<Bool, Layout> &wave,
+                    const std::vector<double> &weights) {
+  double toReturn = 0;
+  Dimension3D dimension = wave.size();
+  runForDimension({dimension.width, dimension.height},
+                  [&](const Index2D &index) {
+                    double sum = 0;
+                    Span<const Bool> patterns = wave.slice(index);
+                    for (size_t t = 0; t < patterns.size(); ++t) {
+                      if (patterns[t]) {
+                        sum += weights[t];
+                      }
+                    }
+                    toReturn += sum;
+                  });
+  return toReturn;
+}
+
+template <class Layout>
+double neighbourhoodSweep(const Array3D<Bool, Layout> &wave) {
+  size_t toReturn = 0;
+  Dimension3D dimension = wave.size();
+  SquareRange range{{-(kN - 1), -(kN - 1)}, {kN - 1, kN - 1}};
+
+  runForDimension({dimension.width, dimension.height},
+                  [&](const Index2D &index) {
+                    range2D(range)([&](const Offset2D &offset) {
+                      Index2D sIndex{
+                          (index.x + dimension.width + offset.x) %
+                              dimension.width,
+                          (index.y + dimension.height + offset.y) %
+                              dimension.height};
+                      for (Bool possible : wave.slice(sIndex)) {
+                        toReturn += possible;
+                      }
+                    });
+                  });
+  return toReturn;
+}
+
+struct Timing {
+  double milliseconds = 0;
+
+  // What the sweep returned, NaN if its runs didn't all agree
+  double result = 0;
+};
+
+template <class Functor> Timing timePerRun(Functor functor) {
+  // Repeat until at least 200ms have been spent, to smooth out noise. Every
+  // run's result is checked, so none of them can be optimised away.
+  Timing toReturn;
+  size_t runs = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::milli> elapsed{0};
+  while (elapsed.count() < 200) {
+    double result = functor();
+    if (runs == 0) {
+      toReturn.result = result;
+    } else if (result != toReturn.result) {
+      toReturn.result = std::numeric_limits<double>::quiet_NaN();
+    }
+    ++runs;
+    elapsed = std::chrono::steady_clock::now() - start;
+  }
+  toReturn.milliseconds = elapsed.count() / runs;
+  return toReturn;
+}
+
+template <class Layout>
+Timing runCase(const char *sweep, size_t side,
+               const std::vector<double> &weights) {
+  auto wave = makeWave<Layout>(side);
+  Timing toReturn;
+  if (std::strcmp(sweep, "entropy") == 0) {
+    toReturn = timePerRun([&] { return entropySweep(wave, weights); });
+  } else {
+    toReturn = timePerRun([&] { return neighbourhoodSweep(wave); });
+  }
+  std::cout << std::setw(8) << toReturn.milliseconds;
+  return toReturn;
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<double> weights(kNumPatterns);
+  for (size_t t = 0; t < kNumPatterns; ++t) {
+    weights[t] = 1.0 + t % 5;
+  }
+
+  // 48x48 is the default output size in samples.cfg
+  std::vector<size_t> sides = {48, 96, 192, 384};
+
+  if (argc == 3) {
+    for (size_t side : sides) {
+      Timing timing = std::strcmp(argv[2], "x") == 0
+                          ? runCase<XMajorLayout>(argv[1], side, weights)
+                          : runCase<RowMajorLayout>(argv[1], side, weights);
+      std::cout << "  " << timing.result << "\n";
+    }
+    return 0;
+  }
+
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "ms per sweep, " << kNumPatterns << " patterns\n";
+  std::cout << "sweep           side  x-major row-major\n";
+  for (const char *sweep : {"entropy", "neighbourhood"}) {
+    for (size_t side : sides) {
+      std::cout << std::setw(14) << std::left << sweep << std::right
+                << std::setw(6) << side;
+      Timing xMajor = runCase<XMajorLayout>(sweep, side, weights);
+      std::cout << "  ";
+      Timing rowMajor = runCase<RowMajorLayout>(sweep, side, weights);
+      // Both layouts visit the cells in the same order, so the sums match
+      std::cout << (xMajor.result == rowMajor.result ? "" : "  DIFFERENT")
+                << "\n";
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+// Times createPropagator and createPropagatorPairwise on real samples against
+// the full T X T X (2n - 1)^2 loop, and checks that all give the same lists.
+//
+// Run from the repository root so samples/ is found, or pass
+// "<image> <n> <symmetry>" to time a single sample.
+
+#include <wfc/configuru.h>
+#include <wfc/overlapping_model.h>
+#include <wfc/overlapping_pattern_extraction.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct BenchmarkSample {
+
+  std::string image;
+
+  int n;
+
+  size_t symmetry;
+};
+
+Propagator fullLoopPropagator(size_t numPatterns, size_t n,
+                              const std::vector<Pattern> &patterns) {
+  Dimension3D propagatorSize{numPatterns, 2 * n - 1, 2 * n - 1};
+  Propagator toReturn(propagatorSize);
+
+  std::vector<PatternIndex> list;
+  for (size_t t = 0; t < propagatorSize.width; ++t) {
+    for (size_t y = 0; y < propagatorSize.depth; ++y) {
+      for (size_t x = 0; x < propagatorSize.height; ++x) {
+        list.clear();
+        for (size_t t2 = 0; t2 < numPatterns; ++t2) {
+          if (agrees(patterns[t], patterns[t2], static_cast<int>(x) - n + 1,
+                     static_cast<int>(y) - n + 1, n)) {
+            list.push_back(t2);
+          }
+        }
+        toReturn.appendList(list);
+      }
+    }
+  }
+  return toReturn;
+}
+
+template <class Functor> double milliseconds(Functor functor) {
+  auto start = std::chrono::steady_clock::now();
+  functor();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+void runSample(const BenchmarkSample &sample) {
+  PalettedImage image = load_paletted_image(sample.image);
+  PatternInfo patternInfo =
+      calculatePatternInfo(image, false, true, sample.symmetry, sample.n);
+
+  std::vector<Pattern> patterns;
+  for (const auto &pattern : patternInfo.patterns) {
+    patterns.push_back(pattern.pattern);
+  }
+  const size_t numPatterns = patterns.size();
+
+  Propagator reference, pairwise, grouped;
+  double fullMs = milliseconds([&] {
+    reference = fullLoopPropagator(numPatterns, sample.n, patterns);
+  });
+  double pairwiseMs = milliseconds([&] {
+    pairwise = createPropagatorPairwise(numPatterns, sample.n, patterns);
+  });
+  double groupedMs = milliseconds(
+      [&] { grouped = createPropagator(numPatterns, sample.n, patterns); });
+
+  std::cout << std::setw(24) << std::left << sample.image << std::right
+            << std::setw(3) << sample.n << std::setw(4) << sample.symmetry
+            << std::setw(7) << numPatterns << std::setw(11) << fullMs
+            << std::setw(11) << pairwiseMs << std::setw(11) << groupedMs
+            << ((reference == pairwise && reference == grouped)
+                    ? ""
+                    : "  DIFFERENT")
+            << "\n";
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<BenchmarkSample> samples = {
+      {"samples/rooms.bmp", 3, 8},    {"samples/city.bmp", 3, 2},
+      {"samples/3bricks.bmp", 3, 1},  {"samples/3bricks.bmp", 3, 8},
+      {"samples/city.bmp", 4, 8},     {"samples/3bricks.bmp", 4, 8},
+  };
+  if (argc == 4) {
+    samples = {{argv[1], std::atoi(argv[2]),
+                static_cast<size_t>(std::atoi(argv[3]))}};
+  }
+
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "ms to build, " << defaultThreadCount() << " threads\n";
+  std::cout << "image                     n sym      T  full loop   pairwise"
+               "    grouped\n";
+  for (const BenchmarkSample &sample : samples) {
+    runSample(sample);
+  }
+  return 0;
+}
@@ -3,6 +3,8 @@
 #include <functional>
 #include <vector>
 
+#include <wfc/algorithm_data_pool.h>
+#include <wfc/backtracking.h>
 #include <wfc/image_generator.h>
 #include <wfc/imodel.h>
 
@@ -26,11 +28,38 @@ struct EntropyResult {
   Index2D minIndex;
 };
 
-struct EntropyValue {
+// What a call to run() did, and how long it took.
+struct RunStatistics {
 
-  size_t num_superimposed;
+  Result result = Result::kUnfinished;
 
-  double entropy;
+  size_t iterations = 0;
+
+  // Observations undone after a contradiction. Always 0 without backtracking.
+  size_t backtracks = 0;
+
+  // Cells collapsed, counting the ones undone by backtracking.
+  size_t observations = 0;
+
+  // Calls to Model::propagate, one after each observation.
+  size_t propagations = 0;
+
+  // Patterns removed from a cell, by observations and propagation alike.
+  size_t bans = 0;
+
+  // Times a cell ran out of patterns. At most 1 without backtracking.
+  size_t contradictions = 0;
+
+  // Largest stateBytes() of the AlgorithmData during the run.
+  size_t peakStateBytes = 0;
+
+  double observeSeconds = 0;
+
+  // Includes undoing the levels backtracking drops.
+  double propagateSeconds = 0;
+
+  // Turning the wave into an image. Only set by createImage.
+  double renderSeconds = 0;
 };
 
 const char *result2str(const Result result);
@@ -40,20 +69,38 @@ double calc_sum(const std::vector<double> &a);
 // Pick a random index weighted by a
 size_t weightedIndexSelect(const std::vector<double> &a, double randFraction);
 
-EntropyResult find_lowest_entropy(const CommonParams &commonParams,
-                                  const Model &model,
-                                  const Array3D<Bool> &wave);
+// Moves the cells marked dirty by ban() into the entropy heap.
+void pushDirtyCells(const Model &model, AlgorithmData &algorithmData);
+
+// Pops the cell with the lowest entropy from the heap. Returns kFail if a cell
+// has run out of patterns and kSuccess once every cell is decided.
+EntropyResult find_lowest_entropy(const Model &model,
+                                  AlgorithmData &algorithmData);
 
+// Collapses the cell with the lowest entropy. If backtracker is given, the
+// observation is recorded on it so it can be undone later.
 Result observe(const CommonParams &commonParams, const Model &model,
-               AlgorithmData *algorithmData, RandomDouble &random_double);
+               AlgorithmData &algorithmData, RandomDouble &random_double,
+               Backtracker *backtracker = nullptr);
 
+// With backtrackDepth > 0, a contradiction undoes up to that many of the
+// latest observations, one per iteration, before the run fails.
 Result run(const CommonParams &commonParams, AlgorithmData &algorithmData,
            const Model &model, size_t seed,
-           size_t limit = 0);
+           size_t limit = 0, size_t backtrackDepth = 0,
+           RunStatistics *statistics = nullptr);
 
 std::unique_ptr<Image>
 createImage(const CommonParams &commonParams, const Model &model, size_t seed,
-            size_t limit = 0);
+            size_t limit = 0, size_t backtrackDepth = 0,
+            RunStatistics *statistics = nullptr);
+
+// Same, but runs on an AlgorithmData from pool, which should have been filled
+// from model.initAlgorithmData().
+std::unique_ptr<Image>
+createImage(const CommonParams &commonParams, const Model &model,
+            AlgorithmDataPool &pool, size_t seed, size_t limit = 0,
+            size_t backtrackDepth = 0, RunStatistics *statistics = nullptr);
 
 AlgorithmData initialOutput(const CommonParams &commonParams,
                             const Model &model);
@@ -63,26 +110,32 @@ class TileModelInternal;
 class OverlappingComputedInfo;
 
 ImageGenerator overlappingGenerator(const OverlappingComputedInfo &config,
-                                    size_t limit = 0);
+                                    size_t limit = 0,
+                                    size_t backtrackDepth = 0);
 
 ImageGenerator tileGenerator(const TileModelInternal &config,
-                             size_t limit = 0);
+                             size_t limit = 0, size_t backtrackDepth = 0);
 
 std::vector<double> createDistribution(const Index2D &index2D,
                                        int numberPatterns,
                                        const std::vector<double> &weights,
-                                       const Array3D<Bool> &wave);
+                                       const Wave &wave);
 
 Index3D waveIndex(const Index2D &imageIndex, int patternIndex);
 
 size_t selectPattern(const Index2D &index2D, int numPatterns,
                      const std::vector<double> &weights,
-                     const Array3D<Bool> &wave,
+                     const Wave &wave,
                      const RandomDouble &randomDouble);
 
-void updateSelectedPattern(AlgorithmData &algorithmData, const Index2D &index2D,
-                           int numPatterns, size_t pattern);
+void updateSelectedPattern(const CommonParams &commonParams,
+                           AlgorithmData &algorithmData, const Index2D &index2D,
+                           size_t pattern);
+
+// Computes the entropy sums of a cell from scratch. During a run the same
+// values are kept up to date in AlgorithmData::_entropies.
+CellEntropy calculateEntropy(const Wave &wave, const Index2D &index2D,
+                             const CommonParams &commonParams);
 
-EntropyValue calculateEntropy(const Array3D<Bool> &wave, const Index2D &index2D,
-                              size_t numPatterns,
-                              const std::vector<double> &patternWeights);
+std::vector<double>
+calculateWeightLogWeights(const std::vector<double> &patternWeights);
@@ -1,18 +1,133 @@
 #pragma once
 
 #include <wfc/arrays.h>
+#include <wfc/entropy_heap.h>
+#include <wfc/wave.h>
+
+#include <deque>
+#include <vector>
 
 // To avoid problems with vector<bool>
 using Bool = uint8_t;
 
+// Number of patterns left in a neighbouring cell which still allow a pattern.
+// Never exceeds the number of patterns, which PatternIndex keeps below 2^16.
+using SupportCount = uint16_t;
+
+struct CommonParams;
+class Model;
+
+// Running sums over the patterns still possible in one cell. They are updated
+// on every ban, so the entropy of a cell can be read without touching the
+// wave.
+struct CellEntropy {
+
+  size_t numPossible;
+
+  double sumOfWeights;
+
+  double sumOfWeightLogWeights;
+
+  // Shannon entropy of the possible patterns, weighted by their weights:
+  // log(sum(w)) - sum(w * log(w)) / sum(w)
+  double entropy;
+};
+
+// A pattern removed from a cell whose consequences for the neighbouring cells
+// have not been propagated yet.
+struct BannedPattern {
+
+  Index2D index;
+
+  size_t pattern;
+};
+
+// A removal recorded so it can be undone, with the entropy sums of the cell
+// as they were before it.
+struct TrailEntry {
+
+  BannedPattern banned;
+
+  CellEntropy before;
+};
+
+// Where a decision level starts on the trail.
+struct TrailLevel {
+
+  size_t trailSize;
+
+  bool contradiction;
+};
+
 // Data used during tiling algorithm operation
 struct AlgorithmData {
-  // _width X _height X num_patterns
+  // _width X _height X num_patterns, one bit per pattern
   // _wave.get(x, y, t) == is the pattern t possible at x, y?
   // Starts off true everywhere.
-  Array3D<Bool> _wave;
-  Array2D<Bool> _changes; // _width X _height. Starts off false everywhere.
+  Wave _wave;
+  // Removals waiting to be propagated. ban() pushes, Model::propagate()
+  // drains it until it is empty.
+  std::vector<BannedPattern> _banStack;
+
+  // Support counters for propagators that keep them (AC-4 style). The layout
+  // is up to the model; empty when the model rescans instead.
+  std::vector<SupportCount> _supportCounts;
+  Array2D<CellEntropy> _entropies; // _width X _height. Kept in sync by ban().
+
+  // Cells ordered by entropy, for observe() to pick from.
+  EntropyHeap _heap;
+  // Cells whose entropy changed since they were last pushed to _heap.
+  // _dirty lists them, _isDirty avoids listing a cell twice.
+  std::vector<Index2D> _dirty;
+  Array2D<Bool> _isDirty;
+  // Set by ban() when a cell runs out of possible patterns.
+  bool _contradiction = false;
+
+  // Undo log. While a level is open, ban() records every removal here, so
+  // the state can be rolled back to the start of any open level in time
+  // proportional to the removals since. Nothing is recorded without levels.
+  std::deque<TrailEntry> _trail;
+  std::vector<TrailLevel> _trailLevels;
+
+  // Removals made by ban() since initialOutput, undone ones included. Only
+  // read for RunStatistics.
+  size_t _numBans = 0;
 };
 
-AlgorithmData initialOutput(const Dimension2D &outputDimensions,
-                            size_t numPatterns);
+AlgorithmData initialOutput(const CommonParams &commonParams);
+
+// Removes pattern from the cell at index, keeping the entropy sums, the
+// dirty list and the contradiction flag in sync, and queues the removal on
+// the ban stack. All changes to the wave after initialOutput should go
+// through here.
+void ban(const CommonParams &commonParams, AlgorithmData &algorithmData,
+         const Index2D &index, size_t pattern);
+
+// The part of ban() after the wave: for a pattern already cleared from the
+// cell, updates the entropy sums, the trail, the dirty list and the
+// contradiction flag, without queueing it. For propagators which clear the
+// wave themselves.
+void recordBan(const CommonParams &commonParams, AlgorithmData &algorithmData,
+               const Index2D &index, size_t pattern);
+
+// Opens a decision level: everything banned from now on can be undone by
+// undoTrailLevel.
+void pushTrailLevel(AlgorithmData &algorithmData);
+
+// Rolls the wave, the entropy sums, the contradiction flag and the model's
+// support counters back to the start of the newest open level, and closes it.
+// The cells it touches are marked dirty again.
+void undoTrailLevel(const Model &model, AlgorithmData &algorithmData);
+
+// Forgets the oldest open level. The removals recorded before the next one
+// can no longer be undone and are dropped from the trail.
+void dropOldestTrailLevel(AlgorithmData &algorithmData);
+
+// Memory held by the wave and the state kept alongside it: entropies, heap,
+// dirty list, ban stack, support counters and trail.
+size_t stateBytes(const AlgorithmData &algorithmData);
+
+// Empties the ban stack and returns the distinct cells it touched, in range2D
+// order. Used by propagators which revise the neighbours of a changed cell in
+// one go rather than once per removed pattern.
+std::vector<Index2D> takeChangedCells(AlgorithmData &algorithmData);
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <wfc/algorithm_data.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Hands out AlgorithmData reset to a pristine template, reusing the buffers
+// of the ones given back, so a run after the first costs copies rather than
+// allocations. Can be shared between workers: each acquire() gets a separate
+// AlgorithmData, which goes back to the pool when the handle is destroyed.
+class AlgorithmDataPool {
+
+  struct Release {
+
+    AlgorithmDataPool *pool;
+
+    void operator()(AlgorithmData *algorithmData) const {
+      pool->release(algorithmData);
+    }
+  };
+
+public:
+  using Handle = std::unique_ptr<AlgorithmData, Release>;
+
+  explicit AlgorithmDataPool(AlgorithmData pristine)
+      : mPristine(std::make_shared<const AlgorithmData>(std::move(pristine))) {
+  }
+
+  // Shares the template instead of copying it, e.g. a model's initialData().
+  explicit AlgorithmDataPool(std::shared_ptr<const AlgorithmData> pristine)
+      : mPristine(std::move(pristine)) {}
+
+  AlgorithmDataPool(const AlgorithmDataPool &) = delete;
+
+  AlgorithmDataPool &operator=(const AlgorithmDataPool &) = delete;
+
+  Handle acquire();
+
+  const AlgorithmData &pristine() const { return *mPristine; }
+
+  // Number of AlgorithmData allocated so far, idle or handed out.
+  size_t numAllocated() const;
+
+private:
+  void release(AlgorithmData *algorithmData);
+
+  const std::shared_ptr<const AlgorithmData> mPristine;
+
+  mutable std::mutex mMutex;
+
+  std::vector<std::unique_ptr<AlgorithmData>> mIdle;
+
+  size_t mNumAllocated = 0;
+};
+
+// Makes target equal to pristine. Copy assignment keeps the capacity of
+// target's buffers, so once they have been sized this only copies.
+void resetAlgorithmData(AlgorithmData &target, const AlgorithmData &pristine);
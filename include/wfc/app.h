@@ -2,11 +2,14 @@
 
 #include <functional>
 #include <string>
+#include <vector>
 
 #include <wfc/image_generator.h>
 
 void runConfiguruFile(const std::string &fileName);
 
 //! \brief Run an image generation function multiple times with different seeds.
+//! If runs is given, the statistics of every seed tried are appended to it.
 void seedLoop(const std::string &name, int numOutput,
-              const ImageGenerator &func);
+              const ImageGenerator &func,
+              std::vector<RunStatistics> *runs = nullptr);
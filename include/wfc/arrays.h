@@ -17,7 +17,84 @@ struct Index2D {
   size_t y;
 };
 
-template <class T> class Array2D {
+struct Index3D {
+
+  size_t x;
+
+  size_t y;
+
+  size_t z;
+};
+
+struct Dimension3D {
+
+  size_t width;
+
+  size_t height;
+
+  size_t depth;
+};
+
+// Non-owning view of count consecutive elements.
+template <class T> struct Span {
+
+  T *ptr;
+
+  size_t count;
+
+  T *begin() const { return ptr; }
+
+  T *end() const { return ptr + count; }
+
+  size_t size() const { return count; }
+
+  bool empty() const { return count == 0; }
+
+  T &operator[](size_t i) const { return ptr[i]; }
+};
+
+// Layout policies decide where an element lives in the flat storage of
+// Array2D and Array3D.
+
+// Cells are stored in the order range2D walks them (y outer, x inner), and the
+// depth of a cell is contiguous, so a sweep over the grid reads memory front
+// to back.
+struct RowMajorLayout {
+
+  static size_t index(const Dimension2D &dimension, size_t x, size_t y) {
+    return y * dimension.width + x;
+  }
+
+  static size_t index(const Dimension3D &dimension, size_t x, size_t y,
+                      size_t z) {
+    return (y * dimension.width + x) * dimension.depth + z;
+  }
+};
+
+// x is the outermost coordinate. This is the original Array3D layout: a row
+// sweep jumps height * depth elements per step.
+struct XMajorLayout {
+
+  static size_t index(const Dimension2D &dimension, size_t x, size_t y) {
+    return x * dimension.height + y;
+  }
+
+  static size_t index(const Dimension3D &dimension, size_t x, size_t y,
+                      size_t z) {
+    return x * dimension.height * dimension.depth + y * dimension.depth + z;
+  }
+};
+
+inline bool operator==(const Dimension2D &left, const Dimension2D &right) {
+  return (left.width == right.width) && (left.height == right.height);
+}
+
+inline bool operator==(const Dimension3D &left, const Dimension3D &right) {
+  return (left.width == right.width) && (left.height == right.height) &&
+         (left.depth == right.depth);
+}
+
+template <class T, class Layout = RowMajorLayout> class Array2D {
 
 public:
   Array2D() : mDimensions{0, 0} {}
@@ -56,7 +133,7 @@ public:
 
   const T *data() const { return mData.data(); }
 
-  bool operator==(const Array2D<T> &other) const {
+  bool operator==(const Array2D &other) const {
     return (mDimensions == other.mDimensions) && (mData == other.mData);
   }
 
@@ -70,32 +147,16 @@ private:
     return toReturn;
   }
 
-  size_t index(size_t x, size_t y) const { return y * mDimensions.width + x; }
+  size_t index(size_t x, size_t y) const {
+    return Layout::index(mDimensions, x, y);
+  }
 
   Dimension2D mDimensions;
 
   std::vector<T> mData;
 };
 
-struct Index3D {
-
-  size_t x;
-
-  size_t y;
-
-  size_t z;
-};
-
-struct Dimension3D {
-
-  size_t width;
-
-  size_t height;
-
-  size_t depth;
-};
-
-template <class T> class Array3D {
+template <class T, class Layout = RowMajorLayout> class Array3D {
 
 public:
   Array3D() : mDimensions{0, 0, 0} {}
@@ -117,10 +178,19 @@ public:
 
   size_t volume() const { return mData.size(); }
 
+  // All depth elements of one (x, y) cell. Both layouts keep z innermost, so
+  // this is always a contiguous run; consecutive cells are depth apart.
+  Span<T> slice(const Index2D &index2D) {
+    return {&mData[index(index2D.x, index2D.y, 0)], mDimensions.depth};
+  }
+
+  Span<const T> slice(const Index2D &index2D) const {
+    return {&mData[index(index2D.x, index2D.y, 0)], mDimensions.depth};
+  }
+
 private:
   size_t index(size_t x, size_t y, size_t z) const {
-    return x * mDimensions.height * mDimensions.depth + y * mDimensions.depth +
-           z;
+    return Layout::index(mDimensions, x, y, z);
   }
 
   Dimension3D mDimensions;
@@ -148,10 +218,6 @@ inline bool operator==(const Index2D &left, const Index2D &right) {
   return (left.x == right.x) && (left.y == right.y);
 }
 
-inline bool operator==(const Dimension2D &left, const Dimension2D &right) {
-  return (left.width == right.width) && (left.height == right.height);
-}
-
 inline bool operator!=(const Index2D &left, const Index2D &right) {
   return (left.x != right.x) || (left.y != right.y);
 }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <wfc/algorithm_data.h>
+#include <wfc/imodel.h>
+
+#include <deque>
+
+// An observation which can be taken back: the cell and the pattern selected
+// for it. The removals it caused are on the trail of the AlgorithmData.
+struct Decision {
+
+  Index2D index;
+
+  size_t pattern;
+};
+
+// Bounded stack of the latest observations of a run. On a contradiction the
+// latest one is undone and its pattern banned, instead of the whole run being
+// thrown away. Once full, the oldest decisions are forgotten.
+class Backtracker {
+
+public:
+  explicit Backtracker(size_t maxDepth) : mMaxDepth(maxDepth) {}
+
+  // Opens a trail level for the observation which is about to set index to
+  // pattern.
+  void record(AlgorithmData &algorithmData, const Index2D &index,
+              size_t pattern);
+
+  // Undoes the latest decision from the trail, bans the pattern it chose and
+  // propagates. Returns false if there is no decision left to undo.
+  bool backtrack(const CommonParams &commonParams, const Model &model,
+                 AlgorithmData &algorithmData);
+
+  size_t depth() const { return mDecisions.size(); }
+
+  size_t maxDepth() const { return mMaxDepth; }
+
+  // Number of decisions undone so far.
+  size_t backtracks() const { return mBacktracks; }
+
+private:
+  std::deque<Decision> mDecisions;
+
+  size_t mMaxDepth;
+
+  size_t mBacktracks = 0;
+};
@@ -36,6 +36,8 @@ loadCopied(const configuru::Config &config, const TileLoader &tileLoader,
 struct GeneralConfig {
   size_t limit;
   size_t numOutput;
+  // Observations a run may undo on a contradiction. 0 restarts instead.
+  size_t backtrackDepth;
 
   const std::string name;
 };
@@ -47,6 +49,10 @@ struct ConfigActions {
 
   std::function<void(const GeneralConfig &, const TileModelConfig &)>
       tileAction;
+
+  // Called once every sample has run, with the top-level metrics_file (empty
+  // if the file doesn't set it). Optional.
+  std::function<void(const std::string &metricsFile)> finishedAction;
 };
 
 void run_config_file(const std::string &path, ConfigActions actions);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <wfc/arrays.h>
+
+#include <algorithm>
+#include <vector>
+
+struct EntropyHeapEntry {
+
+  double entropy;
+
+  Index2D index;
+};
+
+// Orders entries so the heap top is the lowest entropy. Ties go to the cell
+// that comes first in range2D order, as a full scan would pick it.
+struct EntropyHeapCompare {
+
+  bool operator()(const EntropyHeapEntry &left,
+                  const EntropyHeapEntry &right) const {
+    if (left.entropy != right.entropy) {
+      return left.entropy > right.entropy;
+    }
+    if (left.index.y != right.index.y) {
+      return left.index.y > right.index.y;
+    }
+    return left.index.x > right.index.x;
+  }
+};
+
+// Min-heap of cells keyed by entropy. Entries are never updated in place:
+// when the entropy of a cell changes, a new entry is pushed and the old one
+// is left behind. The reader is expected to discard entries whose entropy
+// no longer matches the cell ("lazy invalidation").
+class EntropyHeap {
+
+public:
+  void push(double entropy, const Index2D &index) {
+    mEntries.push_back({entropy, index});
+    std::push_heap(mEntries.begin(), mEntries.end(), EntropyHeapCompare());
+  }
+
+  const EntropyHeapEntry &top() const { return mEntries.front(); }
+
+  void pop() {
+    std::pop_heap(mEntries.begin(), mEntries.end(), EntropyHeapCompare());
+    mEntries.pop_back();
+  }
+
+  bool empty() const { return mEntries.empty(); }
+
+  size_t size() const { return mEntries.size(); }
+
+  void clear() { mEntries.clear(); }
+
+private:
+  std::vector<EntropyHeapEntry> mEntries;
+};
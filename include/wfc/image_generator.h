@@ -1,8 +1,13 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 
 #include <wfc/imodel.h>
 
+struct RunStatistics;
+
+// Makes the image for a seed, or returns nullptr if the run fails. Fills in
+// the statistics if given.
 using ImageGenerator =
-    std::function<std::unique_ptr<Image>(size_t)>;
+    std::function<std::unique_ptr<Image>(size_t, RunStatistics *)>;
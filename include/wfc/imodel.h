@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <vector>
 
 #include <wfc/algorithm_data.h>
@@ -23,14 +24,81 @@ struct CommonParams {
   // The weight of each pattern (e.g. how often that pattern occurs in the
   // sample image).
   std::vector<double> patternWeights;
+
+  // w * log(w) for each entry of patternWeights, see
+  // calculateWeightLogWeights().
+  std::vector<double> patternWeightLogWeights;
 };
 
 using Image = Array2D<RGBA>;
 
+// How a model's fromConfig came by the model.
+struct ModelBuildStatistics {
+
+  // Finding the patterns: extracting them from the sample, or for tiles
+  // rotating the loaded tiles and working out their symmetries. Both 0 when
+  // the model came from the cache.
+  double extractionSeconds = 0;
+
+  // Building the propagator, or the tiles' compatibility lists.
+  double propagatorSeconds = 0;
+
+  // Loading the model from the cache, or saving it there after a miss.
+  double cacheSeconds = 0;
+
+  bool fromCache = false;
+};
+
+// How a model's propagate() finds the patterns to remove.
+enum class PropagationEngine {
+
+  // Revises the whole neighbourhood of every changed cell, looking for a
+  // surviving compatible pattern for each pattern around it.
+  kRescan,
+
+  // Keeps, per (cell, pattern, neighbour), the number of compatible patterns
+  // left in that neighbour, and removes a pattern when one of its counts
+  // drops to zero (AC-4). Work is proportional to the removals, but the
+  // counters take width X height X numPatterns X numNeighbours SupportCounts.
+  kSupportCounters,
+};
+
+// Bytes the support counters of one AlgorithmData take.
+inline size_t supportCounterBytes(const CommonParams &commonParams,
+                                  size_t numNeighbours) {
+  return area(commonParams.mOutputProperties.dimensions) *
+         commonParams.numPatterns * numNeighbours * sizeof(SupportCount);
+}
+
+// AlgorithmData holding counters at once: the model's initial data and the
+// pooled copy a seed runs on, which is reset from it for every seed.
+const size_t kSupportCounterCopies = 2;
+
+// Support counters are used unless all their copies would take more memory
+// than this. They outgrow the wave by far, e.g. 48 X 48 cells of 1000
+// patterns of side 3 need 115 MB of counters a copy against 300 KB of wave.
+const size_t kMaxSupportCounterBytes = size_t(32) << 20;
+
+inline PropagationEngine choosePropagationEngine(const CommonParams &commonParams,
+                                                 size_t numNeighbours) {
+  return kSupportCounterCopies *
+                     supportCounterBytes(commonParams, numNeighbours) <=
+                 kMaxSupportCounterBytes
+             ? PropagationEngine::kSupportCounters
+             : PropagationEngine::kRescan;
+}
+
 class Model {
 
 public:
-  virtual bool propagate(AlgorithmData &algorithmData) const = 0;
+  // Propagates the removals on algorithmData._banStack to the neighbouring
+  // cells until the stack is empty.
+  virtual void propagate(AlgorithmData &algorithmData) const = 0;
+
+  // Reverts what propagate() did to model state, such as support counters,
+  // for a removal which is being undone. Called newest removal first.
+  virtual void unpropagate(AlgorithmData & /*algorithmData*/,
+                           const BannedPattern & /*banned*/) const {}
 
   virtual bool on_boundary(const Index2D &index) const = 0;
 
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <wfc/algorithm.h>
+#include <wfc/overlapping_model.h>
+
+#include <string>
+#include <vector>
+
+// What generating the outputs of one sample took: building the model, then
+// one run per seed tried.
+struct SampleMetrics {
+
+  std::string name;
+
+  size_t numPatterns = 0;
+
+  ModelBuildStatistics build;
+
+  // Only set for overlapping models.
+  bool hasPropagator = false;
+
+  PropagatorStatistics propagator = {};
+
+  // In the order the seeds were tried.
+  std::vector<RunStatistics> runs;
+};
+
+// Totals over runs. peakStateBytes is the largest of them, result is kSuccess
+// if every run succeeded and kFail otherwise.
+RunStatistics aggregate(const std::vector<RunStatistics> &runs);
+
+// The samples as a JSON array, each with its runs and their aggregate.
+std::string metricsToJson(const std::vector<SampleMetrics> &samples);
+
+// Returns false if the file couldn't be written.
+bool writeMetrics(const std::string &path,
+                  const std::vector<SampleMetrics> &samples);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <wfc/overlapping_model.h>
+
+#include <cstdint>
+#include <string>
+
+// Compiled overlapping models on disk, so a second start on the same sample
+// skips pattern extraction and the propagator build.
+//
+// A file is a ModelCacheHeader followed by the sections it counts, each one a
+// plain array in the layout used in memory: weights (double), propagator
+// offsets (uint64_t), propagator entries (PatternIndex), palette (RGBA) and
+// patterns (n * n ColorIndex each, row by row). The header and each section
+// before the entries take a multiple of 8 bytes, and the types narrow from
+// there on, so every section is aligned for its type once the file is mapped.
+//
+// Loading checks the header and the offsets, then reads the propagator, by
+// far the largest part, in place: the model keeps the file mapped. Only the
+// weights, palette and patterns, a few bytes per pattern, are copied.
+
+// Bump whenever the layout or what fromConfig computes changes, e.g. the
+// order of the patterns. Files of other versions are rebuilt.
+const uint32_t kModelCacheVersion = 2;
+
+struct ModelCacheHeader {
+
+  char magic[8];
+
+  uint32_t version;
+
+  uint32_t n;
+
+  // modelCacheKey of the config the model was compiled from.
+  uint64_t key;
+
+  uint64_t foundation;
+
+  uint64_t numColors;
+
+  uint64_t numPatterns;
+
+  // Length of all propagator lists together.
+  uint64_t numEntries;
+};
+
+// Hash of the sample (pixels and palette) and of every setting that changes
+// the compiled model: n, symmetry, periodic_in and foundation.
+uint64_t modelCacheKey(const OverlappingModelConfig &config);
+
+// Where the model with the given key lives in directory.
+std::string modelCachePath(const std::string &directory, uint64_t key);
+
+// Fills info.internal and info.commonParams.patternWeights from the file.
+// Returns false, leaving info alone, if the file is missing, of another
+// version or key, or cut short.
+bool loadCachedModel(const std::string &path, uint64_t key,
+                     OverlappingComputedInfo &info);
+
+// Writes info.internal and info.commonParams.patternWeights, creating the
+// directory of path if needed. The file is written next to path and renamed,
+// so readers never see half of it. Returns false if it couldn't be written.
+bool saveCachedModel(const std::string &path, uint64_t key,
+                     const OverlappingComputedInfo &info);
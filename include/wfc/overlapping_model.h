@@ -3,12 +3,28 @@
 #include <wfc/arrays.h>
 #include <wfc/imodel.h>
 #include <wfc/overlapping_types.h>
+#include <wfc/parallel.h>
+#include <wfc/propagator.h>
+#include <wfc/ranges.h>
+
+#include <string>
 
 using Graphics = Array2D<std::vector<ColorIndex>>;
 
 const size_t kUpscale = 4; // Upscale images before saving
 
-using Propagator = Array3D<std::vector<PatternIndex>>;
+// Which offsets propagation checks around a changed cell.
+enum class OverlapNeighbourhood {
+
+  // Every offset at which two patterns overlap: (2n - 1)^2 of them.
+  kWindow,
+
+  // Only the four unit offsets. Overlaps further away are still enforced
+  // through the cells in between, as every pixel two patterns share is also
+  // covered by the patterns on a path of unit steps between them, but a
+  // removal may take a few more rounds to reach them.
+  kCardinal,
+};
 
 struct OverlappingModelConfig {
   PalettedImage sample_image;
@@ -17,6 +33,10 @@ struct OverlappingModelConfig {
   bool hasfoundation;
   int n;
   OutputProperties outputProperties;
+  // Where fromConfig keeps compiled models (see model_cache.h). Empty to
+  // always compile.
+  std::string cache_dir = "";
+  OverlapNeighbourhood neighbourhood = OverlapNeighbourhood::kWindow;
 };
 
 struct PropagatorStatistics {
@@ -30,8 +50,18 @@ struct PropagatorStatistics {
 
 PropagatorStatistics analyze(const Propagator &propagator);
 
+// Groups the patterns by the part of them each offset overlaps, so the lists
+// come out per group without comparing pairs: roughly linear in the number of
+// patterns plus the length of the lists. Runs on numThreads threads.
 Propagator createPropagator(size_t numPatterns, size_t n,
-                            const std::vector<Pattern> &patterns);
+                            const std::vector<Pattern> &patterns,
+                            size_t numThreads = defaultThreadCount());
+
+// Same lists, built by calling agrees() on every pair of patterns (half of
+// them, by symmetry) at every offset. Kept as a reference for the above.
+Propagator createPropagatorPairwise(size_t numPatterns, size_t n,
+                                    const std::vector<Pattern> &patterns,
+                                    size_t numThreads = defaultThreadCount());
 
 struct OverlappingModelInternal {
   // Index of pattern which is at the base of the image if the image has a base.
@@ -39,8 +69,7 @@ struct OverlappingModelInternal {
   size_t foundation = 0;
 
   int _n;
-  // num_patterns X (2 * n - 1) X (2 * n - 1) X ???
-  // list of other pattern indices that agree on this x/y offset (?)
+  // Patterns that agree with each pattern at each x/y offset
   Propagator _propagator;
   std::vector<Pattern> _patterns;
   Palette _palette;
@@ -51,13 +80,50 @@ struct OverlappingComputedInfo {
   OverlappingModelInternal internal;
 
   CommonParams commonParams;
+
+  OverlapNeighbourhood neighbourhood = OverlapNeighbourhood::kWindow;
+
+  ModelBuildStatistics buildStatistics;
 };
 
+// The offsets propagation checks, in range2D order.
+std::vector<Offset2D> neighbourhoodOffsets(int n,
+                                           OverlapNeighbourhood neighbourhood);
+
+PropagationEngine choosePropagationEngine(const OverlappingComputedInfo &config);
+
+// How the rescan engine tests whether a pattern still has a pattern to
+// overlap with in a changed cell.
+enum class CompatibilityCheck {
+
+  // Walks the propagator list, probing the wave once per entry.
+  kLists,
+
+  // Intersects the cell with the PropagatorMasks of the list.
+  kMasks,
+};
+
+// Masks are used once the average list has at least as many entries as a mask
+// has words, as long as they fit in kMaxPropagatorMaskBytes. On the samples
+// that is all of them: even 3-entry lists against one word are faster masked.
+const size_t kMaxPropagatorMaskBytes = size_t(256) << 20;
+
+CompatibilityCheck chooseCompatibilityCheck(const Propagator &propagator);
+
 class OverlappingModel : public Model {
 public:
   OverlappingModel(const OverlappingComputedInfo &config);
 
-  bool propagate(AlgorithmData &algorithmData) const override;
+  OverlappingModel(const OverlappingComputedInfo &config,
+                   PropagationEngine engine);
+
+  OverlappingModel(const OverlappingComputedInfo &config,
+                   PropagationEngine engine, CompatibilityCheck check);
+
+  void propagate(AlgorithmData &algorithmData) const override;
+
+  void unpropagate(AlgorithmData &algorithmData,
+                   const BannedPattern &banned) const override;
 
   bool on_boundary(const Index2D &index) const override {
     return !mCommonParams.mOutputProperties.periodic &&
@@ -71,14 +137,55 @@ public:
 
   Graphics graphics(const AlgorithmData &algorithmData) const;
 
+  // Returns a copy of the wave after pre-pruning, the foundation and the
+  // initial propagation, which are worked out once when the model is made.
   AlgorithmData initAlgorithmData() const override;
 
+  std::shared_ptr<const AlgorithmData> initialData() const {
+    return mInitialData;
+  }
+
+  PropagationEngine engine() const { return mEngine; }
+
+  // Only used by the rescan engine.
+  CompatibilityCheck compatibilityCheck() const { return mCheck; }
+
 private:
+  template <int N>
+  Graphics graphicsKernel(const AlgorithmData &algorithmData) const;
+
+  void propagateRescan(AlgorithmData &algorithmData) const;
+
+  void propagateSupportCounters(AlgorithmData &algorithmData) const;
+
+  template <class Functor>
+  void forEachSupported(const BannedPattern &banned,
+                        AlgorithmData &algorithmData, Functor functor) const;
+
+  void initSupportCounts(AlgorithmData &algorithmData) const;
+
+  AlgorithmData buildInitialData() const;
+
   CommonParams mCommonParams;
 
   const OverlappingModelInternal &mInternal;
+
+  PropagationEngine mEngine;
+
+  CompatibilityCheck mCheck;
+
+  // See neighbourhoodOffsets(). Support counts are kept per entry.
+  std::vector<Offset2D> mNeighbourhood;
+
+  // Shared by the copies of the model. Only built for the rescan engine with
+  // CompatibilityCheck::kMasks.
+  std::shared_ptr<const PropagatorMasks> mMasks;
+
+  std::shared_ptr<const AlgorithmData> mInitialData;
 };
 
+// Uses the compiled model in config.cache_dir when there is one, and stores
+// it there otherwise. Aborts unless validPatternSide(config.n).
 OverlappingComputedInfo fromConfig(const OverlappingModelConfig &config);
 
 Image image_from_graphics(const Graphics &graphics, const Palette &palette);
@@ -1,13 +1,14 @@
 #pragma once
 
 #include <wfc/overlapping_types.h>
+#include <wfc/parallel.h>
 
+#include <array>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
 
 using PatternHash = uint64_t; // Another representation of a Pattern.
-const PatternHash kInvalidHash = -1;
 
 // A pattern combined with its hash. This is to make patterns suitable for
 // storage in hashtables by allowing their lookup without having to recalculate
@@ -36,8 +37,41 @@ inline bool operator==(const HashedPattern &left, const HashedPattern &right) {
 using PatternPrevalence =
     std::unordered_map<HashedPattern, size_t, PatternHasher>;
 
+// Sum of the cells times powers of palette_size, row by row, last cell
+// lowest. Wraps around once palette_size^(n * n) passes 2^64, after which
+// different patterns may share a hash.
 PatternHash hash_from_pattern(const Pattern &pattern, size_t palette_size);
 
+// Bits needed to hold any colour index of the palette.
+size_t bitsPerColor(size_t palette_size);
+
+// The colour indices of an n X n window packed bitsPerColor bits each, column
+// by column, the first column lowest. Unlike PatternHash it never wraps, so
+// equal keys mean equal windows, but it only exists while the window fits in
+// 128 bits (see fitsPackedKey).
+struct PackedPatternKey {
+
+  uint64_t low = 0;
+
+  uint64_t high = 0;
+
+  bool operator==(const PackedPatternKey &other) const {
+    return low == other.low && high == other.high;
+  }
+
+  struct Hasher {
+
+    size_t operator()(const PackedPatternKey &key) const {
+      // Multiply-xorshift, so keys differing in a few bits spread out
+      uint64_t toReturn = (key.low ^ (key.high * 0x9e3779b97f4a7c15ull)) *
+                          0xbf58476d1ce4e5b9ull;
+      return toReturn ^ (toReturn >> 31);
+    }
+  };
+};
+
+bool fitsPackedKey(int n, size_t palette_size);
+
 struct WeightedPattern {
 
   Pattern pattern;
@@ -96,6 +130,7 @@ inline std::ostream &operator<<(std::ostream &stream,
   stream << ".patternIndex = " << identifier.patternIndex << " ,\n";
   stream << ".enumeratedTransform = " << identifier.enumeratedTransform << "\n";
   stream << "}\n";
+  return stream;
 }
 
 // The extracted patterns found in an image.
@@ -128,6 +163,7 @@ inline std::ostream &operator<<(std::ostream &stream,
   std::cout << "}\n";
 
   std::cout << ".grid = \n" << properties.grid << "\n";
+  return stream;
 }
 
 struct EnumeratedPattern {
@@ -143,17 +179,57 @@ Index2D enumerateTransformProperties(
     const PatternTransformProperties &transformProperties);
 
 PatternInfo calculatePatternInfo(const PalettedImage &image, bool hasFoundation,
-                                 bool periodicIn, size_t symmetry, int n);
+                                 bool periodicIn, size_t symmetry, int n,
+                                 size_t numThreads = defaultThreadCount());
+
+// Samples with at least numThreads * kMinBandPixels windows are extracted on
+// numThreads threads, each taking a band of rows. Smaller bands cost more to
+// start and merge than they save.
+const size_t kMinBandPixels = 1 << 14;
 
-// n = side of the pattern, e.g. 3.
+// n = side of the pattern, e.g. 3. If out_lowest_pattern is given, it is set
+// to the last pattern taken from the bottom row of the sample, if any.
+//
+// Identical windows of the sample are found with a PackedPatternKey where it
+// fits, and with a rolling hash checked against the cells otherwise. Both
+// are updated a column at a time as the window slides along a row. Only the
+// first window of each kind is transformed and looked up; later ones add to
+// the counts of its patterns.
+//
+// Bands of rows are extracted into maps of their own, which are merged in
+// row order. The patterns end up inserted in the order they are first seen
+// in the sample, so they iterate in the same order for any numThreads.
 PatternPrevalence extract_patterns(const PalettedImage &sample, int n,
                                    bool periodic_in, size_t symmetry,
-                                   PatternHash *out_lowest_pattern);
+                                   Pattern *out_lowest_pattern,
+                                   size_t numThreads = defaultThreadCount());
+
+// On more than one thread, a first pass over bands of rows finds the
+// patterns each band starts, which are merged in row order, and a second
+// pass matches every pixel against the merged ones. The result is the same
+// as on a single thread.
+ImagePatternProperties
+extractPatternsFromImage(const PalettedImage &sample, int n,
+                         size_t numThreads = defaultThreadCount());
+
+// The 8 transforms of a pattern, indexed by enumerated transform like an
+// Array2D<Pattern> of {4, 2}, but stored inline.
+struct PatternTransforms {
+
+  std::array<Pattern, 8> patterns;
 
-ImagePatternProperties extractPatternsFromImage(const PalettedImage &sample,
-                                                int n);
+  Pattern &operator[](const Index2D &transform) {
+    return patterns[transform.y * 4 + transform.x];
+  }
+
+  const Pattern &operator[](const Index2D &transform) const {
+    return patterns[transform.y * 4 + transform.x];
+  }
+
+  Dimension2D size() const { return {4, 2}; }
+};
 
-Array2D<Pattern> generatePatterns(const PalettedImage &sample, int n,
+PatternTransforms generatePatterns(const PalettedImage &sample, int n,
                                   const Index2D &index);
 
 Pattern patternFromSample(const PalettedImage &sample, int n,
@@ -3,14 +3,103 @@
 #include <wfc/arrays.h>
 #include <wfc/rgba.h>
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
 #include <vector>
 
 using ColorIndex =
     uint8_t; // tile index or color index. If you have more than 255, don't.
 using Palette = std::vector<RGBA>;
-using Pattern = Array2D<ColorIndex>;
 using PatternIndex = uint16_t;
 
+// Largest n an overlapping model can use.
+const size_t kMaxPatternSide = 8;
+
+// Whether patterns of side n fit in a Pattern.
+inline bool validPatternSide(int n) {
+  return n >= 1 && static_cast<size_t>(n) <= kMaxPatternSide;
+}
+
+// n X n grid of colour indices with the interface of Array2D<ColorIndex>, but
+// stored inline instead of in a std::vector, so making, copying and
+// transforming patterns never allocates. Cells are stored row by row like
+// RowMajorLayout, data() included.
+class Pattern {
+
+public:
+  Pattern() : mWidth(0), mHeight(0), mData{} {}
+
+  explicit Pattern(const Dimension2D &dimension, ColorIndex value = 0)
+      : mWidth(static_cast<uint8_t>(dimension.width)),
+        mHeight(static_cast<uint8_t>(dimension.height)), mData{} {
+    assert(dimension.width <= kMaxPatternSide &&
+           dimension.height <= kMaxPatternSide);
+    std::fill(mData.begin(), mData.begin() + area(size()), value);
+  }
+
+  Pattern(std::initializer_list<std::initializer_list<ColorIndex>> values)
+      : mWidth(0), mHeight(static_cast<uint8_t>(values.size())), mData{} {
+    for (auto yList : values) {
+      mWidth = std::max(mWidth, static_cast<uint8_t>(yList.size()));
+    }
+    assert(mWidth <= kMaxPatternSide && mHeight <= kMaxPatternSide);
+
+    size_t y = 0;
+    for (auto yList : values) {
+      std::copy(yList.begin(), yList.end(), &mData[y * mWidth]);
+      y++;
+    }
+  }
+
+  ColorIndex &operator[](const Index2D &index2D) {
+    return mData[index2D.y * mWidth + index2D.x];
+  }
+
+  ColorIndex operator[](const Index2D &index2D) const {
+    return mData[index2D.y * mWidth + index2D.x];
+  }
+
+  Dimension2D size() const { return {mWidth, mHeight}; }
+
+  const ColorIndex *data() const { return mData.data(); }
+
+  ColorIndex *data() { return mData.data(); }
+
+  bool operator==(const Pattern &other) const {
+    return (mWidth == other.mWidth) && (mHeight == other.mHeight) &&
+           std::equal(mData.begin(), mData.begin() + area(size()),
+                      other.mData.begin());
+  }
+
+  bool operator!=(const Pattern &other) const { return !(*this == other); }
+
+private:
+  uint8_t mWidth;
+
+  uint8_t mHeight;
+
+  std::array<ColorIndex, kMaxPatternSide * kMaxPatternSide> mData;
+};
+
+inline std::ostream &operator<<(std::ostream &stream, const Pattern &pattern) {
+  Dimension2D dimension = pattern.size();
+  stream << "{\n";
+  for (size_t y = 0; y < dimension.height; ++y) {
+    stream << "\t{ ";
+    for (size_t x = 0; x < dimension.width; ++x) {
+      stream << (int)pattern[{x, y}];
+      stream << ", ";
+    }
+    stream << "},\n";
+  }
+  stream << "}\n";
+  return stream;
+}
+
 struct PalettedImage {
   Array2D<ColorIndex> data;
   Palette palette;
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Threads used when a caller doesn't ask for a number.
+inline size_t defaultThreadCount() {
+  return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+// Calls functor(i) for every i in [0, count), spread over numThreads threads
+// (the calling one included). Items are handed out one at a time, so uneven
+// items balance out. Returns once every call has finished.
+template <class Functor>
+void parallelFor(size_t count, Functor functor,
+                 size_t numThreads = defaultThreadCount()) {
+  numThreads = std::min(numThreads, count);
+  if (numThreads <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      functor(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  auto workerFcn = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      functor(i);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(numThreads - 1);
+  for (size_t w = 1; w < numThreads; ++w) {
+    workers.emplace_back(workerFcn);
+  }
+  workerFcn();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
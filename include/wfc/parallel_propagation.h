@@ -0,0 +1,260 @@
+#pragma once
+
+#include <wfc/algorithm_data.h>
+#include <wfc/imodel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Unbounded lock-free queue between one producer thread and one consumer
+// thread. Items go in fixed-size chunks: the producer links a new chunk once
+// the last one is full, and the consumer frees the chunks it has read.
+template <class T> class SpscQueue {
+
+public:
+  SpscQueue() : mHead(new Chunk), mTail(mHead) {}
+
+  SpscQueue(const SpscQueue &) = delete;
+
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  ~SpscQueue() {
+    while (mHead) {
+      Chunk *next = mHead->next.load(std::memory_order_relaxed);
+      delete mHead;
+      mHead = next;
+    }
+  }
+
+  // Producer only.
+  void push(const T &item) {
+    size_t size = mTail->size.load(std::memory_order_relaxed);
+    if (size == kChunkSize) {
+      Chunk *chunk = new Chunk;
+      mTail->next.store(chunk, std::memory_order_release);
+      mTail = chunk;
+      size = 0;
+    }
+    mTail->items[size] = item;
+    mTail->size.store(size + 1, std::memory_order_release);
+  }
+
+  // Consumer only. Returns false if nothing has been pushed since the last
+  // item popped.
+  bool pop(T &item) {
+    if (mRead == kChunkSize) {
+      Chunk *next = mHead->next.load(std::memory_order_acquire);
+      if (!next) {
+        return false;
+      }
+      delete mHead;
+      mHead = next;
+      mRead = 0;
+    }
+    if (mRead == mHead->size.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = mHead->items[mRead++];
+    return true;
+  }
+
+private:
+  static const size_t kChunkSize = 1024;
+
+  struct Chunk {
+
+    T items[kChunkSize];
+
+    std::atomic<size_t> size{0};
+
+    std::atomic<Chunk *> next{nullptr};
+  };
+
+  // Consumer side
+  Chunk *mHead;
+
+  size_t mRead = 0;
+
+  // Producer side
+  Chunk *mTail;
+};
+
+// Splits the rows of the output into numStrips horizontal strips of about the
+// same height.
+class StripPartition {
+
+public:
+  StripPartition(size_t height, size_t numStrips)
+      : mHeight(height), mNumStrips(std::max<size_t>(
+                             1, std::min(numStrips, height))) {}
+
+  size_t numStrips() const { return mNumStrips; }
+
+  // Strip holding row y.
+  size_t owner(size_t y) const { return y * mNumStrips / mHeight; }
+
+  // Calls functor(s) once for every strip s other than own holding one of
+  // the rows y - reach to y + reach, wrapping around the edges.
+  template <class Functor>
+  void forEachStripNear(size_t y, size_t reach, size_t own,
+                        Functor functor) const {
+    auto stripsFcn = [&](size_t first, size_t last) {
+      for (size_t s = first; s <= last; ++s) {
+        if (s != own) {
+          functor(s);
+        }
+      }
+    };
+
+    if (2 * reach + 1 >= mHeight) {
+      stripsFcn(0, mNumStrips - 1);
+    } else if (y >= reach && y + reach < mHeight) {
+      stripsFcn(owner(y - reach), owner(y + reach));
+    } else {
+      // Two runs of rows, one at each edge. The strip the lower run ends in
+      // may also hold the start of the upper one.
+      size_t lowerEnd = y < reach ? y + reach : y + reach - mHeight;
+      size_t upperStart = y < reach ? y + mHeight - reach : y - reach;
+      stripsFcn(0, owner(lowerEnd));
+      stripsFcn(std::max(owner(upperStart), owner(lowerEnd) + 1),
+                mNumStrips - 1);
+    }
+  }
+
+private:
+  size_t mHeight;
+
+  size_t mNumStrips;
+};
+
+// How propagation with support counters is spread over threads.
+struct ParallelPropagation {
+
+  // 1 keeps propagation on the calling thread.
+  size_t numThreads = 1;
+
+  // Removals waiting on the ban stack from which propagate() hands over to
+  // the threads. Starting them costs more than small fronts take.
+  size_t minBans = 1024;
+};
+
+// Propagates the removals on the ban stack with support counters on
+// numThreads threads, one per strip of the output. A thread owns the cells of
+// its strip: only it clears their patterns and changes their counters. The
+// removals it finds are handled by itself, and sent through SpscQueues to
+// the threads owning the rows within reach of them, which update the
+// counters of their own cells.
+//
+// forEachSupported(banned, functor) must call functor(index, count, t) for
+// every counter the removal of banned supports, all within reach rows of it,
+// like the models' member of the same name.
+//
+// The threads only clear the wave. The removals they found are recorded on
+// the calling thread once they are all done, in range2D order, so the
+// entropy sums and the trail don't depend on the number of threads or on
+// their timing. The wave and the counters end up the same as with a single
+// thread, as propagation reaches the same fixed point in any order.
+template <class ForEachSupported>
+void propagateSupportCountersInStrips(const CommonParams &commonParams,
+                                      AlgorithmData &algorithmData,
+                                      size_t numThreads, size_t reach,
+                                      ForEachSupported forEachSupported) {
+  Wave &wave = algorithmData._wave;
+  StripPartition strips(wave.size().height, numThreads);
+  const size_t numStrips = strips.numStrips();
+
+  // queues[from * numStrips + to]
+  std::vector<SpscQueue<BannedPattern>> queues(numStrips * numStrips);
+  std::vector<std::vector<BannedPattern>> stacks(numStrips);
+  std::vector<std::vector<BannedPattern>> found(numStrips);
+
+  // Removals queued or on a stack and not handled yet. Raised before an item
+  // is pushed and lowered once it is handled, so it only reaches 0 when no
+  // thread has anything left to do.
+  std::atomic<size_t> pending{0};
+
+  auto sendFcn = [&](size_t from, const BannedPattern &banned) {
+    pending.fetch_add(1, std::memory_order_relaxed);
+    stacks[from].push_back(banned);
+    strips.forEachStripNear(banned.index.y, reach, from, [&](size_t to) {
+      pending.fetch_add(1, std::memory_order_relaxed);
+      queues[from * numStrips + to].push(banned);
+    });
+  };
+
+  for (const BannedPattern &banned : algorithmData._banStack) {
+    sendFcn(strips.owner(banned.index.y), banned);
+  }
+  algorithmData._banStack.clear();
+
+  auto workerFcn = [&](size_t s) {
+    std::vector<BannedPattern> &stack = stacks[s];
+    size_t nextQueue = 0;
+
+    auto receiveFcn = [&](BannedPattern &banned) {
+      for (size_t i = 0; i < numStrips; ++i) {
+        size_t from = (nextQueue + i) % numStrips;
+        if (from != s && queues[from * numStrips + s].pop(banned)) {
+          nextQueue = from;
+          return true;
+        }
+      }
+      return false;
+    };
+
+    while (pending.load(std::memory_order_acquire) != 0) {
+      BannedPattern banned;
+      if (!stack.empty()) {
+        banned = stack.back();
+        stack.pop_back();
+      } else if (!receiveFcn(banned)) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      forEachSupported(banned, [&](const Index2D &index, SupportCount &count,
+                                   PatternIndex t) {
+        if (strips.owner(index.y) != s) {
+          return;
+        }
+        if (--count == 0 && wave.clear(index, t)) {
+          found[s].push_back({index, t});
+          sendFcn(s, {index, t});
+        }
+      });
+
+      pending.fetch_sub(1, std::memory_order_release);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  workers.reserve(numStrips - 1);
+  for (size_t s = 1; s < numStrips; ++s) {
+    workers.emplace_back(workerFcn, s);
+  }
+  workerFcn(0);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  std::vector<BannedPattern> removals;
+  for (const std::vector<BannedPattern> &stripRemovals : found) {
+    removals.insert(removals.end(), stripRemovals.begin(),
+                    stripRemovals.end());
+  }
+  std::sort(removals.begin(), removals.end(),
+            [](const BannedPattern &left, const BannedPattern &right) {
+              if (left.index.y != right.index.y) {
+                return left.index.y < right.index.y;
+              }
+              if (left.index.x != right.index.x) {
+                return left.index.x < right.index.x;
+              }
+              return left.pattern < right.pattern;
+            });
+  for (const BannedPattern &banned : removals) {
+    recordBan(commonParams, algorithmData, banned.index, banned.pattern);
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// Kernels which loop over the cells of a pattern, or over the offsets at which
+// two patterns overlap, take the side n of the patterns as a template
+// parameter N. For the sizes the samples use the loops then have constant
+// bounds, which the compiler can unroll. N = kAnyPatternSize is the generic
+// instantiation, which reads n at run time.
+const int kAnyPatternSize = 0;
+
+template <int N> struct PatternSize {
+
+  static constexpr int value = N;
+};
+
+// The side of the patterns as seen by a kernel instantiated for N.
+template <int N> constexpr int patternSide(int n) {
+  return N == kAnyPatternSize ? n : N;
+}
+
+// Calls functor(PatternSize<N>()) with N = n if there are kernels for that
+// size (2, 3 and 4), with N = kAnyPatternSize otherwise.
+template <class Functor>
+auto dispatchPatternSize(int n, Functor functor)
+    -> decltype(functor(PatternSize<kAnyPatternSize>())) {
+  switch (n) {
+  case 2:
+    return functor(PatternSize<2>());
+  case 3:
+    return functor(PatternSize<3>());
+  case 4:
+    return functor(PatternSize<4>());
+  default:
+    return functor(PatternSize<kAnyPatternSize>());
+  }
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <wfc/arrays.h>
+#include <wfc/overlapping_types.h>
+#include <wfc/wave.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// num_patterns X (2 * n - 1) X (2 * n - 1) lists of the patterns which agree
+// with pattern t at offset (x - n + 1, y - n + 1), indexed {t, x, y}.
+//
+// Stored compressed (CSR): all lists back to back in one buffer, with the
+// start of every list in a second one. Lists are ordered by pattern, then y,
+// then x, so the lists of one pattern are contiguous and come in the order
+// range2D walks the offsets, which is how propagation reads them. The buffers
+// are either owned or read in place from a mapped model cache file.
+class Propagator {
+
+public:
+  Propagator() : mDimensions{0, 0, 0}, mOffsets{0} { pointAtOwnLists(); }
+
+  explicit Propagator(const Dimension3D &dimensions)
+      : mDimensions(dimensions), mOffsets{0} {
+    mOffsets.reserve(volume() + 1);
+    pointAtOwnLists();
+  }
+
+  // Takes lists already laid out in storage order: list i is
+  // data[offsets[i], offsets[i + 1]).
+  Propagator(const Dimension3D &dimensions, std::vector<uint64_t> offsets,
+             std::vector<PatternIndex> data)
+      : mDimensions(dimensions), mOffsets(std::move(offsets)),
+        mData(std::move(data)) {
+    assert(mOffsets.size() == volume() + 1);
+    pointAtOwnLists();
+  }
+
+  // Same layout, but read in place from memory which storage keeps alive,
+  // e.g. a mapped model cache file. Copies share it.
+  Propagator(const Dimension3D &dimensions, const uint64_t *offsets,
+             const PatternIndex *data, std::shared_ptr<const void> storage)
+      : mDimensions(dimensions), mStorage(std::move(storage)),
+        mOffsetsPtr(offsets), mDataPtr(data),
+        mNumEntries(offsets[volume()]) {}
+
+  Propagator(const Propagator &other)
+      : mDimensions(other.mDimensions), mOffsets(other.mOffsets),
+        mData(other.mData), mStorage(other.mStorage) {
+    pointAt(other);
+  }
+
+  Propagator(Propagator &&other)
+      : mDimensions(other.mDimensions), mOffsets(std::move(other.mOffsets)),
+        mData(std::move(other.mData)), mStorage(std::move(other.mStorage)) {
+    pointAt(other);
+  }
+
+  Propagator &operator=(Propagator other) {
+    mDimensions = other.mDimensions;
+    mOffsets = std::move(other.mOffsets);
+    mData = std::move(other.mData);
+    mStorage = std::move(other.mStorage);
+    pointAt(other);
+    return *this;
+  }
+
+  // Appends the list of the next index in storage order.
+  void appendList(const std::vector<PatternIndex> &list) {
+    assert(!mStorage && mOffsets.size() <= volume());
+    mData.insert(mData.end(), list.begin(), list.end());
+    mOffsets.push_back(mData.size());
+    pointAtOwnLists();
+  }
+
+  Span<const PatternIndex> operator[](const Index3D &index3D) const {
+    size_t list = index(index3D);
+    return {mDataPtr + mOffsetsPtr[list],
+            static_cast<size_t>(mOffsetsPtr[list + 1] - mOffsetsPtr[list])};
+  }
+
+  Dimension3D size() const { return mDimensions; }
+
+  size_t volume() const {
+    return mDimensions.width * mDimensions.height * mDimensions.depth;
+  }
+
+  // Total length of all the lists.
+  size_t numEntries() const { return mNumEntries; }
+
+  // The storage itself, as taken by the constructors above.
+  Span<const uint64_t> offsets() const {
+    return {mOffsetsPtr, mStorage ? volume() + 1 : mOffsets.size()};
+  }
+
+  Span<const PatternIndex> entries() const { return {mDataPtr, mNumEntries}; }
+
+  bool operator==(const Propagator &other) const {
+    return (mDimensions == other.mDimensions) &&
+           (offsets().size() == other.offsets().size()) &&
+           std::equal(offsets().begin(), offsets().end(),
+                      other.offsets().begin()) &&
+           (mNumEntries == other.mNumEntries) &&
+           std::equal(entries().begin(), entries().end(),
+                      other.entries().begin());
+  }
+
+private:
+  size_t index(const Index3D &index3D) const {
+    return (index3D.x * mDimensions.depth + index3D.z) * mDimensions.height +
+           index3D.y;
+  }
+
+  void pointAtOwnLists() {
+    mOffsetsPtr = mOffsets.data();
+    mDataPtr = mData.data();
+    mNumEntries = mData.size();
+  }
+
+  // After taking the lists of other, owned or shared.
+  void pointAt(const Propagator &other) {
+    if (mStorage) {
+      mOffsetsPtr = other.mOffsetsPtr;
+      mDataPtr = other.mDataPtr;
+      mNumEntries = other.mNumEntries;
+    } else {
+      pointAtOwnLists();
+    }
+  }
+
+  Dimension3D mDimensions;
+
+  // Owned lists, empty when they are read from mStorage
+  std::vector<uint64_t> mOffsets;
+
+  std::vector<PatternIndex> mData;
+
+  std::shared_ptr<const void> mStorage;
+
+  // Where the lists are read from, either of the above
+  const uint64_t *mOffsetsPtr;
+
+  const PatternIndex *mDataPtr;
+
+  size_t mNumEntries;
+};
+
+// The same lists as a Propagator, as masks of numPatterns bits laid out like
+// a cell of the Wave. Whether a cell still holds any pattern of a list is then
+// one Wave::intersects call, a word at a time, instead of a probe per entry.
+// Worth it when the lists are long compared to the number of words.
+class PropagatorMasks {
+
+public:
+  PropagatorMasks() : mDimensions{0, 0, 0}, mWordsPerList(0) {}
+
+  explicit PropagatorMasks(const Propagator &propagator)
+      : mDimensions(propagator.size()),
+        mWordsPerList(wordsForPatterns(mDimensions.width)),
+        mData(propagator.volume() * mWordsPerList, 0) {
+    for (size_t t = 0; t < mDimensions.width; ++t) {
+      for (size_t y = 0; y < mDimensions.depth; ++y) {
+        for (size_t x = 0; x < mDimensions.height; ++x) {
+          WaveWord *mask = mData.data() + index({t, x, y}) * mWordsPerList;
+          for (PatternIndex t2 : propagator[{t, x, y}]) {
+            mask[t2 / kWaveWordBits] |= WaveWord(1) << (t2 % kWaveWordBits);
+          }
+        }
+      }
+    }
+  }
+
+  const WaveWord *operator[](const Index3D &index3D) const {
+    return mData.data() + index(index3D) * mWordsPerList;
+  }
+
+  size_t bytes() const { return mData.size() * sizeof(WaveWord); }
+
+private:
+  // Same order as Propagator
+  size_t index(const Index3D &index3D) const {
+    return (index3D.x * mDimensions.depth + index3D.z) * mDimensions.height +
+           index3D.y;
+  }
+
+  Dimension3D mDimensions;
+
+  size_t mWordsPerList;
+
+  std::vector<WaveWord> mData;
+};
@@ -10,6 +10,28 @@ struct Offset2D {
   int y;
 };
 
+// Moves index by offset, wrapping around the edges of dimension.
+inline Index2D shiftWrapped(const Index2D &index, const Offset2D &offset,
+                            const Dimension2D &dimension) {
+  int sx = static_cast<int>(index.x) + offset.x;
+  int sy = static_cast<int>(index.y) + offset.y;
+
+  // Do wrap around (always-positive modulus)
+  if (sx < 0) {
+    sx += dimension.width;
+  } else if (sx >= static_cast<int>(dimension.width)) {
+    sx -= dimension.width;
+  }
+
+  if (sy < 0) {
+    sy += dimension.height;
+  } else if (sy >= static_cast<int>(dimension.height)) {
+    sy -= dimension.height;
+  }
+
+  return {static_cast<size_t>(sx), static_cast<size_t>(sy)};
+}
+
 //! \brief Defines a square range. The bottomLeft and upperRight
 //! are included in the range.
 struct SquareRange {
@@ -21,9 +43,10 @@ struct SquareRange {
 
 inline auto range2D(const SquareRange &range) {
   return [=](auto consumingFcn) {
-    // Order is weird, but can/should be changed.
-    for (int x = range.bottomLeft.x; x <= range.upperRight.x; ++x) {
-      for (int y = range.bottomLeft.y; y <= range.upperRight.y; ++y) {
+    // Same order as range2D(Dimension2D), so neighbourhood walks follow the
+    // row-major storage of the grids.
+    for (int y = range.bottomLeft.y; y <= range.upperRight.y; ++y) {
+      for (int x = range.bottomLeft.x; x <= range.upperRight.x; ++x) {
         consumingFcn(Offset2D{x, y});
       }
     }
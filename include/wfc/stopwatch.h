@@ -0,0 +1,21 @@
+#pragma once
+
+#include <chrono>
+
+// Measures wall-clock time from when it is made or last restarted.
+class Stopwatch {
+
+public:
+  Stopwatch() : mStart(std::chrono::steady_clock::now()) {}
+
+  void restart() { mStart = std::chrono::steady_clock::now(); }
+
+  double seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         mStart)
+        .count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point mStart;
+};
@@ -2,6 +2,8 @@
 
 #include <wfc/arrays.h>
 #include <wfc/imodel.h>
+#include <wfc/overlapping_types.h>
+#include <wfc/parallel_propagation.h>
 #include <wfc/rgba.h>
 
 #include <functional>
@@ -18,9 +20,18 @@ struct TileModelInternal {
   // 4 X numPatterns X numPatterns
   Array3D<Bool> _propagator;
 
+  // 4 X numPatterns lists of the t2 with _propagator[{d, t1, t2}] set, i.e.
+  // the tiles which t1 allows next to it in direction d.
+  Array2D<std::vector<PatternIndex>> _compatible;
+
   std::vector<std::vector<RGBA>> _tiles;
 
   size_t _tile_size;
+
+  // Only used with support counters.
+  ParallelPropagation parallelPropagation;
+
+  ModelBuildStatistics buildStatistics;
 };
 
 class TileModel : public Model {
@@ -28,20 +39,55 @@ class TileModel : public Model {
 public:
   TileModel(const TileModelInternal &internal);
 
-  bool propagate(AlgorithmData &algorithmData) const override;
+  TileModel(const TileModelInternal &internal, PropagationEngine engine);
+
+  void propagate(AlgorithmData &algorithmData) const override;
+
+  void unpropagate(AlgorithmData &algorithmData,
+                   const BannedPattern &banned) const override;
 
   bool on_boundary(const Index2D &index) const override;
 
   std::unique_ptr<Image> image(const AlgorithmData &algorithmData) const override;
 
+  // Returns a copy of the wave after pre-pruning and the initial
+  // propagation, which are worked out once when the model is made.
   AlgorithmData initAlgorithmData() const override;
 
+  std::shared_ptr<const AlgorithmData> initialData() const {
+    return mInitialData;
+  }
+
+  PropagationEngine engine() const { return mEngine; }
+
 private:
+  void propagateRescan(AlgorithmData &algorithmData) const;
+
+  void propagateSupportCounters(AlgorithmData &algorithmData) const;
+
+  template <class Functor>
+  void forEachSupported(const BannedPattern &banned,
+                        AlgorithmData &algorithmData, Functor functor) const;
+
+  void initSupportCounts(AlgorithmData &algorithmData) const;
+
+  AlgorithmData buildInitialData() const;
+
+  // Cell next to index in direction d, if there is one.
+  bool neighbor(const Index2D &index, size_t d, Index2D &toReturn) const;
+
   CommonParams mCommonParams;
 
   const TileModelInternal &mInternal;
+
+  PropagationEngine mEngine;
+
+  // Shared by the copies of the model
+  std::shared_ptr<const AlgorithmData> mInitialData;
 };
 
+PropagationEngine choosePropagationEngine(const TileModelInternal &config);
+
 Tile rotate(const Tile &in_tile, const size_t tile_size);
 
 enum class Symmetry {
@@ -123,6 +169,9 @@ struct TileModelConfig {
   std::vector<Neighbors> neighbors;
 
   OutputProperties commonParam;
+
+  // Threads propagation may use on large fronts (see parallel_propagation.h).
+  size_t propagationThreads = 1;
 };
 
 TileModelInternal fromConfig(const TileModelConfig &config);
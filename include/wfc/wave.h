@@ -0,0 +1,265 @@
+#pragma once
+
+#include <wfc/arrays.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using WaveWord = uint64_t;
+
+const size_t kWaveWordBits = 64;
+
+inline size_t popcount(WaveWord word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(word);
+#else
+  return std::bitset<kWaveWordBits>(word).count();
+#endif
+}
+
+// Index of the lowest set bit. word must not be 0.
+inline size_t lowestBit(WaveWord word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(word);
+#else
+  size_t toReturn = 0;
+  while (!(word & 1)) {
+    word >>= 1;
+    ++toReturn;
+  }
+  return toReturn;
+#endif
+}
+
+// Clears the bits of mask in *word as one atomic operation, and returns the
+// bits the word had before.
+inline WaveWord atomicFetchAnd(WaveWord *word, WaveWord mask) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __atomic_fetch_and(word, mask, __ATOMIC_RELAXED);
+#elif defined(_MSC_VER)
+  return _InterlockedAnd64(reinterpret_cast<volatile __int64 *>(word), mask);
+#else
+  static_assert(std::atomic<WaveWord>::is_always_lock_free &&
+                    sizeof(std::atomic<WaveWord>) == sizeof(WaveWord),
+                "WaveWord must have a lock-free atomic of the same size");
+  return reinterpret_cast<std::atomic<WaveWord> *>(word)->fetch_and(
+      mask, std::memory_order_relaxed);
+#endif
+}
+
+// Reads *word while other threads may be clearing bits of it.
+inline WaveWord atomicLoad(const WaveWord *word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __atomic_load_n(word, __ATOMIC_RELAXED);
+#elif defined(_MSC_VER)
+  return *reinterpret_cast<const volatile WaveWord *>(word);
+#else
+  return reinterpret_cast<const std::atomic<WaveWord> *>(word)->load(
+      std::memory_order_relaxed);
+#endif
+}
+
+inline size_t wordsForPatterns(size_t numPatterns) {
+  return (numPatterns + kWaveWordBits - 1) / kWaveWordBits;
+}
+
+// Calls functor(t) for every bit t set in the given run of words.
+template <class Functor>
+void forEachSetBit(const WaveWord *words, size_t numWords, Functor functor) {
+  for (size_t w = 0; w < numWords; ++w) {
+    WaveWord word = words[w];
+    while (word) {
+      functor(w * kWaveWordBits + lowestBit(word));
+      word &= word - 1;
+    }
+  }
+}
+
+// Bit-packed version of the width X height X num_patterns grid of booleans.
+// One bit per (cell, pattern), and every cell starts on a word boundary, so
+// the patterns of one cell can be tested, masked and counted a word at a time.
+// Cells are stored row by row, matching the order range2D walks them.
+class Wave {
+
+public:
+  Wave() : mDimensions{0, 0}, mNumPatterns(0), mWordsPerCell(0) {}
+
+  Wave(const Dimension2D &dimension, size_t numPatterns, bool value = true)
+      : mDimensions(dimension), mNumPatterns(numPatterns),
+        mWordsPerCell(wordsForPatterns(numPatterns)),
+        mData(area(dimension) * mWordsPerCell, 0) {
+    if (value) {
+      fill(true);
+    }
+  }
+
+  bool operator[](const Index3D &index3D) const {
+    return get({index3D.x, index3D.y}, index3D.z);
+  }
+
+  bool get(const Index2D &index2D, size_t pattern) const {
+    return (cell(index2D)[pattern / kWaveWordBits] >>
+            (pattern % kWaveWordBits)) &
+           1;
+  }
+
+  void set(const Index3D &index3D, bool value) {
+    WaveWord &word = cell({index3D.x, index3D.y})[index3D.z / kWaveWordBits];
+    WaveWord bit = WaveWord(1) << (index3D.z % kWaveWordBits);
+    if (value) {
+      word |= bit;
+    } else {
+      word &= ~bit;
+    }
+  }
+
+  // Removes the pattern from the cell. Returns whether it was possible before.
+  bool clear(const Index2D &index2D, size_t pattern) {
+    WaveWord &word = cell(index2D)[pattern / kWaveWordBits];
+    WaveWord bit = WaveWord(1) << (pattern % kWaveWordBits);
+    bool wasSet = (word & bit) != 0;
+    word &= ~bit;
+    return wasSet;
+  }
+
+  // Sets every pattern of every cell to the given value.
+  void fill(bool value) {
+    if (!value) {
+      std::fill(mData.begin(), mData.end(), 0);
+      return;
+    }
+
+    for (size_t c = 0; c < area(mDimensions); ++c) {
+      WaveWord *words = mData.data() + c * mWordsPerCell;
+      for (size_t w = 0; w < mWordsPerCell; ++w) {
+        words[w] = ~WaveWord(0);
+      }
+      if (mNumPatterns % kWaveWordBits) {
+        words[mWordsPerCell - 1] =
+            (WaveWord(1) << (mNumPatterns % kWaveWordBits)) - 1;
+      }
+    }
+  }
+
+  const WaveWord *cell(const Index2D &index2D) const {
+    return mData.data() + cellIndex(index2D) * mWordsPerCell;
+  }
+
+  WaveWord *cell(const Index2D &index2D) {
+    return mData.data() + cellIndex(index2D) * mWordsPerCell;
+  }
+
+  // Number of patterns still possible in the cell.
+  size_t count(const Index2D &index2D) const {
+    const WaveWord *words = cell(index2D);
+    size_t toReturn = 0;
+    for (size_t w = 0; w < mWordsPerCell; ++w) {
+      toReturn += popcount(words[w]);
+    }
+    return toReturn;
+  }
+
+  // Whether any pattern possible in the cell is also set in mask.
+  bool intersects(const Index2D &index2D, const WaveWord *mask) const {
+    const WaveWord *words = cell(index2D);
+    for (size_t w = 0; w < mWordsPerCell; ++w) {
+      if (words[w] & mask[w]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Calls functor(t) for every pattern t possible in the cell.
+  template <class Functor>
+  void forEachPattern(const Index2D &index2D, Functor functor) const {
+    forEachSetBit(cell(index2D), mWordsPerCell, functor);
+  }
+
+  Dimension2D size() const { return mDimensions; }
+
+  size_t numPatterns() const { return mNumPatterns; }
+
+  size_t wordsPerCell() const { return mWordsPerCell; }
+
+  bool operator==(const Wave &other) const {
+    return (mDimensions == other.mDimensions) &&
+           (mNumPatterns == other.mNumPatterns) && (mData == other.mData);
+  }
+
+  // Memory used by the bits themselves.
+  size_t bytes() const { return mData.size() * sizeof(WaveWord); }
+
+private:
+  size_t cellIndex(const Index2D &index2D) const {
+    return index2D.y * mDimensions.width + index2D.x;
+  }
+
+  Dimension2D mDimensions;
+
+  size_t mNumPatterns;
+
+  size_t mWordsPerCell;
+
+  std::vector<WaveWord> mData;
+};
+
+// View of a Wave through which several threads may remove patterns at once,
+// from the same cell too. Words are cleared with an atomic fetch_and, so when
+// threads race to remove a pattern exactly one of them is told it did, and
+// only that one should queue the work which follows from the removal. Reads
+// may miss removals other threads are making at the time, i.e. see more
+// patterns than are left.
+//
+// It has the calls of Wave which a propagator makes. Wave itself is the
+// single-threaded fast path, without atomics, and is enough wherever a cell
+// is only ever cleared by one thread, as in propagateSupportCountersInStrips.
+// Nothing may set patterns or resize the wave while a view is in use.
+class ConcurrentWave {
+
+public:
+  explicit ConcurrentWave(Wave &wave) : mWave(wave) {}
+
+  bool get(const Index2D &index2D, size_t pattern) const {
+    return (atomicLoad(mWave.cell(index2D) + pattern / kWaveWordBits) >>
+            (pattern % kWaveWordBits)) &
+           1;
+  }
+
+  // Removes the pattern from the cell. Returns whether this call removed it.
+  bool clear(const Index2D &index2D, size_t pattern) {
+    WaveWord bit = WaveWord(1) << (pattern % kWaveWordBits);
+    return clearWord(index2D, pattern / kWaveWordBits, bit) != 0;
+  }
+
+  // Removes the patterns set in mask from word w of the cell. Returns the
+  // ones this call removed.
+  WaveWord clearWord(const Index2D &index2D, size_t w, WaveWord mask) {
+    return atomicFetchAnd(mWave.cell(index2D) + w, ~mask) & mask;
+  }
+
+  size_t count(const Index2D &index2D) const {
+    const WaveWord *words = mWave.cell(index2D);
+    size_t toReturn = 0;
+    for (size_t w = 0; w < mWave.wordsPerCell(); ++w) {
+      toReturn += popcount(atomicLoad(words + w));
+    }
+    return toReturn;
+  }
+
+  Dimension2D size() const { return mWave.size(); }
+
+  size_t numPatterns() const { return mWave.numPatterns(); }
+
+  size_t wordsPerCell() const { return mWave.wordsPerCell(); }
+
+private:
+  Wave &mWave;
+};
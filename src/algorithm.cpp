@@ -2,6 +2,7 @@
 
 #include <wfc/overlapping_model.h>
 #include <wfc/ranges.h>
+#include <wfc/stopwatch.h>
 #include <wfc/tile_model.h>
 
 #include <algorithm>
@@ -45,84 +46,72 @@ size_t weightedIndexSelect(const std::vector<double> &a, double randFraction) {
   return 0;
 }
 
-EntropyValue calculateEntropy(const Array3D<Bool> &wave, const Index2D &index2D,
-                              size_t numPatterns,
-                              const std::vector<double> &patternWeights) {
-  EntropyValue entropyResult = {0, 0};
+CellEntropy calculateEntropy(const Wave &wave, const Index2D &index2D,
+                             const CommonParams &commonParams) {
+  CellEntropy toReturn = {wave.count(index2D), 0, 0, 0};
 
-  for (int t = 0; t < numPatterns; ++t) {
-    Index3D index = append(index2D, t);
-    if (wave[index]) {
-      entropyResult.num_superimposed += 1;
-      entropyResult.entropy += patternWeights[t];
-    }
+  wave.forEachPattern(index2D, [&](size_t t) {
+    toReturn.sumOfWeights += commonParams.patternWeights[t];
+    toReturn.sumOfWeightLogWeights += commonParams.patternWeightLogWeights[t];
+  });
+
+  if (toReturn.numPossible > 1) {
+    toReturn.entropy = std::log(toReturn.sumOfWeights) -
+                       toReturn.sumOfWeightLogWeights / toReturn.sumOfWeights;
   }
-  return entropyResult;
+  return toReturn;
 }
 
-EntropyResult find_lowest_entropy(const CommonParams &commonParams,
-                                  const Model &model,
-                                  const Array3D<Bool> &wave) {
-  // We actually calculate exp(entropy), i.e. the sum of the weights of the
-  // possible patterns
-
-  double min = std::numeric_limits<double>::infinity();
-
-  // TODO: This is almost always (0, 0) for the initial iteration. Perhaps an
-  // explicit seeding should be used? Note: it is not (0, 0) when the pattern
-  // has foundation, as this modifies the wave, resulting in a value besides (0,
-  // 0)
-  Index2D minIndex;
-
-  bool fail = false;
-
-  auto func = [&](auto index2D) {
-    if (model.on_boundary(index2D)) {
-      return false;
-    }
+std::vector<double>
+calculateWeightLogWeights(const std::vector<double> &patternWeights) {
+  std::vector<double> toReturn;
+  toReturn.reserve(patternWeights.size());
+  for (double weight : patternWeights) {
+    toReturn.push_back(weight * std::log(weight));
+  }
+  return toReturn;
+}
 
-    EntropyValue entropyResult = calculateEntropy(
-        wave, index2D, commonParams.numPatterns, commonParams.patternWeights);
+void pushDirtyCells(const Model &model, AlgorithmData &algorithmData) {
+  for (const Index2D &index : algorithmData._dirty) {
+    algorithmData._isDirty[index] = false;
 
-    if (entropyResult.entropy == 0 || entropyResult.num_superimposed == 0) {
-      fail = true;
-      return true;
+    if (model.on_boundary(index)) {
+      continue;
     }
 
-    if (entropyResult.num_superimposed == 1) {
-      // Cell pattern is finalized
-      return false;
+    const CellEntropy &cellEntropy = algorithmData._entropies[index];
+    if (cellEntropy.numPossible > 1) {
+      algorithmData._heap.push(cellEntropy.entropy, index);
     }
+  }
+  algorithmData._dirty.clear();
+}
 
-    // TODO: Add this back in, or remove?
-    /*
-    // Add a tie-breaking bias:
-    const double noise = 0.5 * random_double();
-    entropy += noise;
-    */
+EntropyResult find_lowest_entropy(const Model &model,
+                                  AlgorithmData &algorithmData) {
+  if (algorithmData._contradiction) {
+    // Fail because a cell in the wave had no possible patterns that will fit
+    return EntropyResult{Result::kFail, {}};
+  }
 
-    if (entropyResult.entropy < min) {
-      min = entropyResult.entropy;
-      minIndex = index2D;
-    }
-    return false;
-  };
+  pushDirtyCells(model, algorithmData);
 
-  Dimension2D dimension = commonParams.mOutputProperties.dimensions;
-  BreakRange::runForDimension(dimension, func);
+  // Skip entries left behind by cells whose entropy changed or that have been
+  // decided since they were pushed
+  EntropyHeap &heap = algorithmData._heap;
+  while (!heap.empty()) {
+    EntropyHeapEntry entry = heap.top();
+    heap.pop();
 
-  Result result;
-  if (fail) {
-    // Fail because a cell in the wave had no possible patterns that will fit
-    result = Result::kFail;
-  } else if (min == std::numeric_limits<double>::infinity()) {
-    // All cells were finalized "num_superimposed == 1"
-    result = Result::kSuccess;
-  } else {
-    result = Result::kUnfinished;
+    const CellEntropy &cellEntropy = algorithmData._entropies[entry.index];
+    if (cellEntropy.numPossible > 1 && cellEntropy.entropy == entry.entropy) {
+      return EntropyResult{Result::kUnfinished, entry.index};
+    }
   }
 
-  return EntropyResult{result, minIndex};
+  // All cells were finalized "numPossible == 1"
+  return EntropyResult{Result::kSuccess, {}};
 }
 
 Index3D waveIndex(const Index2D &imageIndex, int patternIndex) {
@@ -131,19 +120,17 @@ Index3D waveIndex(const Index2D &imageIndex, int patternIndex) {
 
 std::vector<double> createDistribution(const Index2D &index2D, int numPatterns,
                                        const std::vector<double> &weights,
-                                       const Array3D<Bool> &wave) {
-  std::vector<double> distribution(numPatterns);
-  for (int patternIndex = 0; patternIndex < numPatterns; ++patternIndex) {
-    Index3D index3D = waveIndex(index2D, patternIndex);
-
-    distribution[patternIndex] = wave[index3D] ? weights[patternIndex] : 0;
-  }
+                                       const Wave &wave) {
+  std::vector<double> distribution(numPatterns, 0);
+  wave.forEachPattern(index2D, [&](size_t patternIndex) {
+    distribution[patternIndex] = weights[patternIndex];
+  });
   return distribution;
 }
 
 size_t selectPattern(const Index2D &index2D, int numPatterns,
                      const std::vector<double> &weights,
-                     const Array3D<Bool> &wave,
+                     const Wave &wave,
                      const RandomDouble &randomDouble) {
   std::vector<double> distribution =
       createDistribution(index2D, numPatterns, weights, wave);
@@ -151,22 +138,22 @@ size_t selectPattern(const Index2D &index2D, int numPatterns,
   return weightedIndexSelect(distribution, randomDouble());
 }
 
-void updateSelectedPattern(AlgorithmData &algorithmData, const Index2D &index2D,
-                           int numPatterns, size_t pattern) {
-  for (int t = 0; t < numPatterns; ++t) {
-    Index3D index3D = waveIndex(index2D, t);
-
-    // Set pattern to true, everything else false
-    algorithmData._wave[index3D] = (t == pattern);
-  }
-  algorithmData._changes[index2D] = true;
+void updateSelectedPattern(const CommonParams &commonParams,
+                           AlgorithmData &algorithmData, const Index2D &index2D,
+                           size_t pattern) {
+  // Set pattern to true, everything else false
+  algorithmData._wave.forEachPattern(index2D, [&](size_t t) {
+    if (t != pattern) {
+      ban(commonParams, algorithmData, index2D, t);
+    }
+  });
 }
 
 Result observe(const CommonParams &commonParams, const Model &model,
-               AlgorithmData &algorithmData, RandomDouble &random_double) {
+               AlgorithmData &algorithmData, RandomDouble &random_double,
+               Backtracker *backtracker) {
   // Find the index in the image with the lowest entropy
-  const auto result =
-      find_lowest_entropy(commonParams, model, algorithmData._wave);
+  const auto result = find_lowest_entropy(model, algorithmData);
 
   if (result.code != Result::kUnfinished) {
     return result.code;
@@ -179,62 +166,151 @@ Result observe(const CommonParams &commonParams, const Model &model,
                            commonParams.patternWeights, algorithmData._wave,
                            random_double);
 
+  if (backtracker) {
+    backtracker->record(algorithmData, index2D, r);
+  }
+
   // The index is modified in the following way:
   // - Wave set to true at pattern index, false everywhere else
-  // - The index is marked in changes
-  updateSelectedPattern(algorithmData, index2D, commonParams.numPatterns, r);
+  // - The removed patterns are pushed on the ban stack
+  updateSelectedPattern(commonParams, algorithmData, index2D, r);
 
   return Result::kUnfinished;
 }
 
 Result run(const CommonParams &commonParams, AlgorithmData &algorithmData,
            const Model &model, size_t seed,
-           size_t limit) {
+           size_t limit, size_t backtrackDepth,
+           RunStatistics *statistics) {
   std::mt19937 gen(time(nullptr) + seed);
   std::uniform_real_distribution<double> dis(0.0, 1.0);
   RandomDouble random_double = [&]() { return dis(gen); };
 
+  Backtracker backtracker(backtrackDepth);
+  Backtracker *maybeBacktracker = backtrackDepth ? &backtracker : nullptr;
+
+  RunStatistics runStatistics;
+  const size_t bansBefore = algorithmData._numBans;
+
+  auto reportFcn = [&](Result result, size_t iterations) {
+    runStatistics.result = result;
+    runStatistics.iterations = iterations;
+    runStatistics.backtracks = backtracker.backtracks();
+    runStatistics.bans = algorithmData._numBans - bansBefore;
+    runStatistics.peakStateBytes =
+        std::max(runStatistics.peakStateBytes, stateBytes(algorithmData));
+    if (statistics) {
+      *statistics = runStatistics;
+    }
+    if (result == Result::kUnfinished) {
+      std::cout << "Unfinished after " << iterations << " iterations";
+    } else {
+      std::cout << result2str(result) << " after " << iterations
+                << " iterations";
+    }
+    if (backtrackDepth) {
+      std::cout << ", " << backtracker.backtracks() << " backtracks";
+    }
+    std::cout << "\n";
+  };
+
   for (size_t l = 0; limit == 0 || l < limit; ++l) {
-    Result result = observe(commonParams, model, algorithmData, random_double);
+    runStatistics.peakStateBytes =
+        std::max(runStatistics.peakStateBytes, stateBytes(algorithmData));
+
+    Stopwatch stopwatch;
+    Result result = observe(commonParams, model, algorithmData, random_double,
+                            maybeBacktracker);
+    runStatistics.observeSeconds += stopwatch.seconds();
+
+    if (result == Result::kFail) {
+      ++runStatistics.contradictions;
+      stopwatch.restart();
+      bool backtracked =
+          backtracker.backtrack(commonParams, model, algorithmData);
+      runStatistics.propagateSeconds += stopwatch.seconds();
+      if (backtracked) {
+        continue;
+      }
+    }
 
     if (result != Result::kUnfinished) {
-      std::cout << result2str(result) << " after " << l << " iterations\n";
+      reportFcn(result, l);
       return result;
     }
-    while (model.propagate(algorithmData))
-      ;
+    ++runStatistics.observations;
+
+    stopwatch.restart();
+    model.propagate(algorithmData);
+    runStatistics.propagateSeconds += stopwatch.seconds();
+    ++runStatistics.propagations;
   }
 
-  std::cout << "Unfinished after " << limit << " iterations\n";
+  reportFcn(Result::kUnfinished, limit);
   return Result::kUnfinished;
 }
 
 std::unique_ptr<Image>
 createImage(const CommonParams &commonParams, const Model &model, size_t seed,
-            size_t limit) {
+            size_t limit, size_t backtrackDepth, RunStatistics *statistics) {
   AlgorithmData algorithmData = model.initAlgorithmData();
 
-  const auto result = run(commonParams, algorithmData, model, seed, limit);
+  const auto result = run(commonParams, algorithmData, model, seed, limit,
+                          backtrackDepth, statistics);
 
   if (result == Result::kSuccess) {
-    return model.image(algorithmData);
+    Stopwatch stopwatch;
+    std::unique_ptr<Image> toReturn = model.image(algorithmData);
+    if (statistics) {
+      statistics->renderSeconds = stopwatch.seconds();
+    }
+    return toReturn;
+  } else {
+    return nullptr;
+  }
+}
+
+std::unique_ptr<Image>
+createImage(const CommonParams &commonParams, const Model &model,
+            AlgorithmDataPool &pool, size_t seed, size_t limit,
+            size_t backtrackDepth, RunStatistics *statistics) {
+  AlgorithmDataPool::Handle algorithmData = pool.acquire();
+
+  const auto result = run(commonParams, *algorithmData, model, seed, limit,
+                          backtrackDepth, statistics);
+
+  if (result == Result::kSuccess) {
+    Stopwatch stopwatch;
+    std::unique_ptr<Image> toReturn = model.image(*algorithmData);
+    if (statistics) {
+      statistics->renderSeconds = stopwatch.seconds();
+    }
+    return toReturn;
   } else {
     return nullptr;
   }
 }
 
+// Every seed runs on a pooled copy of the initial AlgorithmData the model
+// worked out when it was made.
 ImageGenerator overlappingGenerator(const OverlappingComputedInfo &config,
-                                    size_t limit) {
+                                    size_t limit, size_t backtrackDepth) {
   OverlappingModel model(config);
-  return [limit, model, &config](size_t seed) {
-    return createImage(config.commonParams, model, seed, limit);
+  auto pool = std::make_shared<AlgorithmDataPool>(model.initialData());
+  return [limit, backtrackDepth, model, pool,
+          &config](size_t seed, RunStatistics *statistics) {
+    return createImage(config.commonParams, model, *pool, seed, limit,
+                       backtrackDepth, statistics);
   };
 }
 
 ImageGenerator tileGenerator(const TileModelInternal &config,
-                             size_t limit) {
+                             size_t limit, size_t backtrackDepth) {
   TileModel model(config);
-  return [limit, model, &config](size_t seed) {
-    return createImage(config.mCommonParams, model, seed, limit);
+  auto pool = std::make_shared<AlgorithmDataPool>(model.initialData());
+  return [limit, backtrackDepth, model, pool,
+          &config](size_t seed, RunStatistics *statistics) {
+    return createImage(config.mCommonParams, model, *pool, seed, limit,
+                       backtrackDepth, statistics);
   };
 }
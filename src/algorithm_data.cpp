@@ -1,8 +1,163 @@
 #include <wfc/algorithm_data.h>
 
-AlgorithmData initialOutput(const Dimension2D &outputDimensions,
-                            size_t numPatterns) {
-  Dimension3D waveDimension = append(outputDimensions, numPatterns);
-  return {Array3D<Bool>(waveDimension, true),
-          Array2D<Bool>(outputDimensions, false)};
+#include <wfc/imodel.h>
+#include <wfc/ranges.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+void markDirty(AlgorithmData &algorithmData, const Index2D &index) {
+  if (!algorithmData._isDirty[index]) {
+    algorithmData._isDirty[index] = true;
+    algorithmData._dirty.push_back(index);
+  }
+}
+
+} // namespace
+
+AlgorithmData initialOutput(const CommonParams &commonParams) {
+  Dimension2D outputDimensions = commonParams.mOutputProperties.dimensions;
+
+  CellEntropy initialEntropy = {commonParams.numPatterns, 0, 0, 0};
+  for (size_t t = 0; t < commonParams.numPatterns; ++t) {
+    initialEntropy.sumOfWeights += commonParams.patternWeights[t];
+    initialEntropy.sumOfWeightLogWeights +=
+        commonParams.patternWeightLogWeights[t];
+  }
+  initialEntropy.entropy =
+      std::log(initialEntropy.sumOfWeights) -
+      initialEntropy.sumOfWeightLogWeights / initialEntropy.sumOfWeights;
+
+  AlgorithmData toReturn;
+  toReturn._wave = Wave(outputDimensions, commonParams.numPatterns, true);
+  toReturn._entropies = Array2D<CellEntropy>(outputDimensions, initialEntropy);
+
+  // Every cell starts out dirty, so the first observe() fills the heap.
+  toReturn._isDirty = Array2D<Bool>(outputDimensions, true);
+  toReturn._dirty.reserve(area(outputDimensions));
+  runForDimension(outputDimensions, [&](const Index2D &index) {
+    toReturn._dirty.push_back(index);
+  });
+
+  return toReturn;
+}
+
+void ban(const CommonParams &commonParams, AlgorithmData &algorithmData,
+         const Index2D &index, size_t pattern) {
+  if (!algorithmData._wave.clear(index, pattern)) {
+    return;
+  }
+
+  recordBan(commonParams, algorithmData, index, pattern);
+  algorithmData._banStack.push_back({index, pattern});
+}
+
+void recordBan(const CommonParams &commonParams, AlgorithmData &algorithmData,
+               const Index2D &index, size_t pattern) {
+  CellEntropy &cellEntropy = algorithmData._entropies[index];
+  if (!algorithmData._trailLevels.empty()) {
+    algorithmData._trail.push_back({{index, pattern}, cellEntropy});
+  }
+
+  cellEntropy.numPossible -= 1;
+  cellEntropy.sumOfWeights -= commonParams.patternWeights[pattern];
+  cellEntropy.sumOfWeightLogWeights -=
+      commonParams.patternWeightLogWeights[pattern];
+
+  if (cellEntropy.numPossible <= 1) {
+    // Avoids leftover rounding error once the cell is decided
+    cellEntropy.entropy = 0;
+    if (cellEntropy.numPossible == 0) {
+      algorithmData._contradiction = true;
+    }
+  } else {
+    cellEntropy.entropy =
+        std::log(cellEntropy.sumOfWeights) -
+        cellEntropy.sumOfWeightLogWeights / cellEntropy.sumOfWeights;
+  }
+
+  markDirty(algorithmData, index);
+
+  ++algorithmData._numBans;
+}
+
+void pushTrailLevel(AlgorithmData &algorithmData) {
+  algorithmData._trailLevels.push_back(
+      {algorithmData._trail.size(), algorithmData._contradiction});
+}
+
+void undoTrailLevel(const Model &model, AlgorithmData &algorithmData) {
+  std::vector<TrailLevel> &levels = algorithmData._trailLevels;
+  if (levels.empty()) {
+    return;
+  }
+
+  // Only removals which have been propagated show up in the support counters
+  model.propagate(algorithmData);
+
+  const TrailLevel level = levels.back();
+  levels.pop_back();
+
+  std::deque<TrailEntry> &trail = algorithmData._trail;
+  while (trail.size() > level.trailSize) {
+    const TrailEntry &entry = trail.back();
+    const Index2D &index = entry.banned.index;
+
+    model.unpropagate(algorithmData, entry.banned);
+    algorithmData._wave.set(append(index, entry.banned.pattern), true);
+    algorithmData._entropies[index] = entry.before;
+    markDirty(algorithmData, index);
+
+    trail.pop_back();
+  }
+
+  algorithmData._contradiction = level.contradiction;
+}
+
+void dropOldestTrailLevel(AlgorithmData &algorithmData) {
+  std::vector<TrailLevel> &levels = algorithmData._trailLevels;
+  if (levels.empty()) {
+    return;
+  }
+  levels.erase(levels.begin());
+
+  size_t dropped = levels.empty() ? algorithmData._trail.size()
+                                  : levels.front().trailSize;
+  algorithmData._trail.erase(algorithmData._trail.begin(),
+                             algorithmData._trail.begin() + dropped);
+  for (TrailLevel &level : levels) {
+    level.trailSize -= dropped;
+  }
+}
+
+size_t stateBytes(const AlgorithmData &algorithmData) {
+  const size_t cells = area(algorithmData._wave.size());
+  return algorithmData._wave.bytes() +
+         cells * (sizeof(CellEntropy) + sizeof(Bool)) +
+         algorithmData._heap.size() * sizeof(EntropyHeapEntry) +
+         algorithmData._dirty.capacity() * sizeof(Index2D) +
+         algorithmData._banStack.capacity() * sizeof(BannedPattern) +
+         algorithmData._supportCounts.size() * sizeof(SupportCount) +
+         algorithmData._trail.size() * sizeof(TrailEntry) +
+         algorithmData._trailLevels.capacity() * sizeof(TrailLevel);
+}
+
+std::vector<Index2D> takeChangedCells(AlgorithmData &algorithmData) {
+  std::vector<Index2D> toReturn;
+  toReturn.reserve(algorithmData._banStack.size());
+  for (const BannedPattern &banned : algorithmData._banStack) {
+    toReturn.push_back(banned.index);
+  }
+  algorithmData._banStack.clear();
+
+  auto rangeOrder = [](const Index2D &left, const Index2D &right) {
+    return (left.y != right.y) ? left.y < right.y : left.x < right.x;
+  };
+  std::sort(toReturn.begin(), toReturn.end(), rangeOrder);
+  toReturn.erase(std::unique(toReturn.begin(), toReturn.end()),
+                 toReturn.end());
+
+  return toReturn;
 }
@@ -0,0 +1,36 @@
+#include <wfc/algorithm_data_pool.h>
+
+AlgorithmDataPool::Handle AlgorithmDataPool::acquire() {
+  std::unique_ptr<AlgorithmData> toReturn;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mIdle.empty()) {
+      toReturn = std::move(mIdle.back());
+      mIdle.pop_back();
+    } else {
+      ++mNumAllocated;
+    }
+  }
+
+  // Copying happens outside the lock, so workers don't wait on each other
+  if (toReturn) {
+    resetAlgorithmData(*toReturn, *mPristine);
+  } else {
+    toReturn = std::make_unique<AlgorithmData>(*mPristine);
+  }
+  return Handle(toReturn.release(), Release{this});
+}
+
+size_t AlgorithmDataPool::numAllocated() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mNumAllocated;
+}
+
+void AlgorithmDataPool::release(AlgorithmData *algorithmData) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  mIdle.emplace_back(algorithmData);
+}
+
+void resetAlgorithmData(AlgorithmData &target, const AlgorithmData &pristine) {
+  target = pristine;
+}
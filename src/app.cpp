@@ -2,6 +2,7 @@
 
 #include <wfc/algorithm.h>
 #include <wfc/configuru.h>
+#include <wfc/metrics.h>
 
 #include <stb_image_write.h>
 
@@ -9,27 +10,51 @@
 #include <sstream>
 
 void runConfiguruFile(const std::string &fileName) {
+  std::vector<SampleMetrics> samples;
 
   ConfigActions actions = {
-      [](const GeneralConfig &generalConfig,
-         const OverlappingModelConfig &overlappingModelConfig) {
+      [&samples](const GeneralConfig &generalConfig,
+                 const OverlappingModelConfig &overlappingModelConfig) {
         auto computedInfo = fromConfig(overlappingModelConfig);
-        auto imageGenerator =
-            overlappingGenerator(computedInfo, generalConfig.limit);
-        seedLoop(generalConfig.name, generalConfig.numOutput, imageGenerator);
+        auto imageGenerator = overlappingGenerator(
+            computedInfo, generalConfig.limit, generalConfig.backtrackDepth);
+
+        SampleMetrics metrics;
+        metrics.name = generalConfig.name;
+        metrics.numPatterns = computedInfo.commonParams.numPatterns;
+        metrics.build = computedInfo.buildStatistics;
+        metrics.hasPropagator = true;
+        metrics.propagator = analyze(computedInfo.internal._propagator);
+        seedLoop(generalConfig.name, generalConfig.numOutput, imageGenerator,
+                 &metrics.runs);
+        samples.push_back(std::move(metrics));
       },
-      [](const GeneralConfig &generalConfig,
-         const TileModelConfig &tileModelConfig) {
+      [&samples](const GeneralConfig &generalConfig,
+                 const TileModelConfig &tileModelConfig) {
         auto internal = fromConfig(tileModelConfig);
-        auto imageGenerator = tileGenerator(internal, generalConfig.limit);
-        seedLoop(generalConfig.name, generalConfig.numOutput, imageGenerator);
+
+        SampleMetrics metrics;
+        metrics.name = generalConfig.name;
+        metrics.numPatterns = internal.mCommonParams.numPatterns;
+        metrics.build = internal.buildStatistics;
+
+        auto imageGenerator = tileGenerator(internal, generalConfig.limit,
+                                            generalConfig.backtrackDepth);
+        seedLoop(generalConfig.name, generalConfig.numOutput, imageGenerator,
+                 &metrics.runs);
+        samples.push_back(std::move(metrics));
+      },
+      [&samples](const std::string &metricsFile) {
+        if (!metricsFile.empty() && !writeMetrics(metricsFile, samples)) {
+          std::cout << "Failed to write metrics to " << metricsFile << "\n";
+        }
       }};
 
   run_config_file(fileName, actions);
 }
 
 void seedLoop(const std::string &name, int numOutput,
-              const ImageGenerator &func) {
+              const ImageGenerator &func, std::vector<RunStatistics> *runs) {
   int numTries = 0;
   int numSuccess = 0;
   const int maxTries = 10 * numOutput;
@@ -41,7 +66,11 @@ void seedLoop(const std::string &name, int numOutput,
   while (numTries < maxTries && numSuccess < desiredSuccess) {
     ++numTries;
     // Generate an image based on the seed
-    auto result = func(randSeed++);
+    RunStatistics statistics;
+    auto result = func(randSeed++, &statistics);
+    if (runs) {
+      runs->push_back(statistics);
+    }
 
     if (result) {
       const auto &image = *result;
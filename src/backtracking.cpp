@@ -0,0 +1,33 @@
+#include <wfc/backtracking.h>
+
+void Backtracker::record(AlgorithmData &algorithmData, const Index2D &index,
+                         size_t pattern) {
+  if (mMaxDepth == 0) {
+    return;
+  }
+  if (mDecisions.size() == mMaxDepth) {
+    mDecisions.pop_front();
+    dropOldestTrailLevel(algorithmData);
+  }
+
+  mDecisions.push_back({index, pattern});
+  pushTrailLevel(algorithmData);
+}
+
+bool Backtracker::backtrack(const CommonParams &commonParams,
+                            const Model &model, AlgorithmData &algorithmData) {
+  if (mDecisions.empty()) {
+    return false;
+  }
+
+  const Decision decision = mDecisions.back();
+  mDecisions.pop_back();
+  undoTrailLevel(model, algorithmData);
+  ++mBacktracks;
+
+  // The pattern led to a contradiction, so it can't go here. If that leaves
+  // the cell empty, the next call undoes the decision before this one.
+  ban(commonParams, algorithmData, decision.index, decision.pattern);
+  model.propagate(algorithmData);
+  return true;
+}
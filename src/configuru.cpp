@@ -174,17 +174,28 @@ PalettedImage load_paletted_image(const std::string &path) {
 OverlappingModelConfig
 extractOverlappingConfig(const std::string &image_dir,
                          const configuru::Config &config) {
+  const int n = config.get_or("n", 3);
+  if (!validPatternSide(n)) {
+    config["n"].on_error("n must be between 1 and " +
+                         std::to_string(kMaxPatternSide));
+  }
+
   const auto image_filename = config["image"].as_string();
   const auto in_path = image_dir + image_filename;
 
-  return {load_paletted_image(in_path),
-          config.get_or("periodic_in", true),
-          (size_t)config.get_or("symmetry", 8),
-          config.get_or("foundation", false),
-          config.get_or("n", 3),
-          {{(size_t)config.get_or("width", 48),
-            (size_t)config.get_or("height", 48)},
-           config.get_or("periodic_out", true)}};
+  OverlappingModelConfig toReturn{
+      load_paletted_image(in_path),
+      config.get_or("periodic_in", true),
+      (size_t)config.get_or("symmetry", 8),
+      config.get_or("foundation", false),
+      n,
+      {{(size_t)config.get_or("width", 48),
+        (size_t)config.get_or("height", 48)},
+       config.get_or("periodic_out", true)}};
+  if (config.get_or("cardinal", false)) {
+    toReturn.neighbourhood = OverlapNeighbourhood::kCardinal;
+  }
+  return toReturn;
 }
 
 Tile loadTile(const std::string &subdir, const std::string &image_dir,
@@ -246,7 +257,7 @@ TileModelConfig extractConfig(const std::string &image_dir,
 
   auto neighbors = loadNeighbors(config);
 
-  return {
+  TileModelConfig toReturn = {
       tileSize,
       subset,
       uniqueFlag,
@@ -257,6 +268,8 @@ TileModelConfig extractConfig(const std::string &image_dir,
         (size_t)topConfig.get_or("height", 48)},
        topConfig.get_or("periodic", false)},
   };
+  toReturn.propagationThreads = (size_t)topConfig.get_or("threads", 1);
+  return toReturn;
 }
 
 GeneralConfig importGeneralConfig(const std::string &name,
@@ -267,13 +280,15 @@ GeneralConfig importGeneralConfig(const std::string &name,
     actualLimit = importedLimit;
   }
 
-  return {actualLimit, (size_t)config.get_or("numOutput", 2), name};
+  return {actualLimit, (size_t)config.get_or("numOutput", 2),
+          (size_t)config.get_or("backtrack", 0), name};
 }
 
 void run_config_file(const std::string &path, ConfigActions actions) {
   //LOG_F(INFO, "Running all samples in %s", path.c_str());
   const auto samples = configuru::parse_file(path, configuru::CFG);
   const auto image_dir = samples["image_dir"].as_string();
+  const auto cache_dir = samples.get_or("cache_dir", std::string());
 
   if (samples.count("overlapping")) {
     for (const auto &p : samples["overlapping"].as_object()) {
@@ -286,6 +301,7 @@ void run_config_file(const std::string &path, ConfigActions actions) {
 
       OverlappingModelConfig overlappingModelConfig =
           extractOverlappingConfig(image_dir, config);
+      overlappingModelConfig.cache_dir = cache_dir;
       actions.overlappingAction(generalConfig, overlappingModelConfig);
 
       p.value().check_dangling();
@@ -305,4 +321,8 @@ void run_config_file(const std::string &path, ConfigActions actions) {
       actions.tileAction(generalConfig, tileModelConfig);
     }
   }
+
+  if (actions.finishedAction) {
+    actions.finishedAction(samples.get_or("metrics_file", std::string()));
+  }
 }
@@ -0,0 +1,100 @@
+#include <wfc/metrics.h>
+
+#include <configuru.hpp>
+
+#include <algorithm>
+#include <fstream>
+
+namespace {
+
+configuru::Config toConfig(const RunStatistics &statistics) {
+  configuru::Config toReturn = configuru::Config::object();
+  toReturn["result"] = std::string(result2str(statistics.result));
+  toReturn["iterations"] = statistics.iterations;
+  toReturn["backtracks"] = statistics.backtracks;
+  toReturn["observations"] = statistics.observations;
+  toReturn["propagations"] = statistics.propagations;
+  toReturn["bans"] = statistics.bans;
+  toReturn["contradictions"] = statistics.contradictions;
+  toReturn["peak_state_bytes"] = statistics.peakStateBytes;
+  toReturn["observe_seconds"] = statistics.observeSeconds;
+  toReturn["propagate_seconds"] = statistics.propagateSeconds;
+  toReturn["render_seconds"] = statistics.renderSeconds;
+  return toReturn;
+}
+
+configuru::Config toConfig(const SampleMetrics &sample) {
+  configuru::Config toReturn = configuru::Config::object();
+  toReturn["name"] = sample.name;
+  toReturn["patterns"] = sample.numPatterns;
+
+  configuru::Config build = configuru::Config::object();
+  build["extraction_seconds"] = sample.build.extractionSeconds;
+  build["propagator_seconds"] = sample.build.propagatorSeconds;
+  build["cache_seconds"] = sample.build.cacheSeconds;
+  build["from_cache"] = sample.build.fromCache;
+  toReturn["build"] = build;
+
+  if (sample.hasPropagator) {
+    configuru::Config propagator = configuru::Config::object();
+    propagator["longest"] = sample.propagator.longest_propagator;
+    propagator["sum"] = sample.propagator.sum_propagator;
+    propagator["average"] = sample.propagator.average;
+    toReturn["propagator"] = propagator;
+  }
+
+  size_t successes = std::count_if(
+      sample.runs.begin(), sample.runs.end(), [](const RunStatistics &run) {
+        return run.result == Result::kSuccess;
+      });
+  configuru::Config total = toConfig(aggregate(sample.runs));
+  total["runs"] = sample.runs.size();
+  total["successes"] = successes;
+  toReturn["total"] = total;
+
+  configuru::Config runs = configuru::Config::array();
+  for (const RunStatistics &run : sample.runs) {
+    runs.push_back(toConfig(run));
+  }
+  toReturn["runs"] = runs;
+  return toReturn;
+}
+
+} // namespace
+
+RunStatistics aggregate(const std::vector<RunStatistics> &runs) {
+  RunStatistics toReturn;
+  toReturn.result = Result::kSuccess;
+  for (const RunStatistics &run : runs) {
+    if (run.result != Result::kSuccess) {
+      toReturn.result = Result::kFail;
+    }
+    toReturn.iterations += run.iterations;
+    toReturn.backtracks += run.backtracks;
+    toReturn.observations += run.observations;
+    toReturn.propagations += run.propagations;
+    toReturn.bans += run.bans;
+    toReturn.contradictions += run.contradictions;
+    toReturn.peakStateBytes =
+        std::max(toReturn.peakStateBytes, run.peakStateBytes);
+    toReturn.observeSeconds += run.observeSeconds;
+    toReturn.propagateSeconds += run.propagateSeconds;
+    toReturn.renderSeconds += run.renderSeconds;
+  }
+  return toReturn;
+}
+
+std::string metricsToJson(const std::vector<SampleMetrics> &samples) {
+  configuru::Config toDump = configuru::Config::array();
+  for (const SampleMetrics &sample : samples) {
+    toDump.push_back(toConfig(sample));
+  }
+  return configuru::dump_string(toDump, configuru::JSON);
+}
+
+bool writeMetrics(const std::string &path,
+                  const std::vector<SampleMetrics> &samples) {
+  std::ofstream stream(path);
+  stream << metricsToJson(samples);
+  return static_cast<bool>(stream);
+}
@@ -0,0 +1,283 @@
+#include <wfc/model_cache.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(ModelCacheHeader) % alignof(uint64_t) == 0,
+              "sections after the header must stay aligned");
+static_assert(alignof(RGBA) <= alignof(PatternIndex) &&
+                  alignof(ColorIndex) <= alignof(RGBA),
+              "sections must narrow in alignment");
+
+namespace {
+
+const char kModelCacheMagic[8] = {'W', 'F', 'C', 'M', 'O', 'D', 'E', 'L'};
+
+// Read-only view of a whole file. Mapped where mmap is available, read into
+// memory otherwise.
+class MappedFile {
+
+public:
+  explicit MappedFile(const std::string &path) {
+#ifdef _WIN32
+    std::ifstream stream(path, std::ios::binary);
+    if (stream) {
+      mBuffer.assign(std::istreambuf_iterator<char>(stream),
+                     std::istreambuf_iterator<char>());
+      mData = mBuffer.data();
+      mSize = mBuffer.size();
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0) {
+      void *mapped =
+          mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED) {
+        mData = static_cast<const char *>(mapped);
+        mSize = status.st_size;
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() {
+#ifndef _WIN32
+    if (mData) {
+      munmap(const_cast<char *>(mData), mSize);
+    }
+#endif
+  }
+
+  const char *data() const { return mData; }
+
+  size_t size() const { return mSize; }
+
+private:
+  const char *mData = nullptr;
+
+  size_t mSize = 0;
+
+#ifdef _WIN32
+  std::vector<char> mBuffer;
+#endif
+};
+
+// FNV-1a
+class KeyHasher {
+
+public:
+  void add(const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+      mHash = (mHash ^ bytes[i]) * 1099511628211ull;
+    }
+  }
+
+  void add(uint64_t value) { add(&value, sizeof(value)); }
+
+  uint64_t hash() const { return mHash; }
+
+private:
+  uint64_t mHash = 14695981039346656037ull;
+};
+
+void createParentDirectory(const std::string &path) {
+  size_t slash = path.find_last_of("/\\");
+  if (slash == std::string::npos || slash == 0) {
+    return;
+  }
+  std::string directory = path.substr(0, slash);
+#ifdef _WIN32
+  _mkdir(directory.c_str());
+#else
+  mkdir(directory.c_str(), 0755);
+#endif
+}
+
+// Bytes taken by the sections after the header.
+size_t sectionBytes(const ModelCacheHeader &header) {
+  size_t side = 2 * header.n - 1;
+  size_t numLists = header.numPatterns * side * side;
+  return header.numPatterns * sizeof(double) +
+         (numLists + 1) * sizeof(uint64_t) +
+         header.numEntries * sizeof(PatternIndex) +
+         header.numColors * sizeof(RGBA) +
+         header.numPatterns * header.n * header.n * sizeof(ColorIndex);
+}
+
+template <class T> void writeArray(std::ostream &stream, const T *data,
+                                   size_t count) {
+  stream.write(reinterpret_cast<const char *>(data), count * sizeof(T));
+}
+
+} // namespace
+
+uint64_t modelCacheKey(const OverlappingModelConfig &config) {
+  const Array2D<ColorIndex> &pixels = config.sample_image.data;
+  const Palette &palette = config.sample_image.palette;
+
+  KeyHasher hasher;
+  hasher.add(kModelCacheVersion);
+  hasher.add(pixels.size().width);
+  hasher.add(pixels.size().height);
+  hasher.add(pixels.data(), area(pixels.size()) * sizeof(ColorIndex));
+  hasher.add(palette.size());
+  hasher.add(palette.data(), palette.size() * sizeof(RGBA));
+  hasher.add(static_cast<uint64_t>(config.n));
+  hasher.add(config.symmetry);
+  hasher.add(config.periodic_in);
+  hasher.add(config.hasfoundation);
+  return hasher.hash();
+}
+
+std::string modelCachePath(const std::string &directory, uint64_t key) {
+  std::stringstream stream;
+  stream << directory;
+  if (!directory.empty() && directory.back() != '/') {
+    stream << "/";
+  }
+  stream << std::hex << key << ".wfcmodel";
+  return stream.str();
+}
+
+bool loadCachedModel(const std::string &path, uint64_t key,
+                     OverlappingComputedInfo &info) {
+  auto file = std::make_shared<const MappedFile>(path);
+  if (file->size() < sizeof(ModelCacheHeader)) {
+    return false;
+  }
+
+  ModelCacheHeader header;
+  std::memcpy(&header, file->data(), sizeof(header));
+  if (std::memcmp(header.magic, kModelCacheMagic, sizeof(kModelCacheMagic)) ||
+      header.version != kModelCacheVersion || header.key != key ||
+      header.n == 0 || header.n > kMaxPatternSide ||
+      file->size() != sizeof(header) + sectionBytes(header)) {
+    return false;
+  }
+
+  size_t n = header.n;
+  size_t side = 2 * n - 1;
+  size_t numLists = header.numPatterns * side * side;
+
+  const char *cursor = file->data() + sizeof(header);
+  auto sectionFcn = [&](size_t bytes) {
+    const char *toReturn = cursor;
+    cursor += bytes;
+    return toReturn;
+  };
+
+  const double *weights = reinterpret_cast<const double *>(
+      sectionFcn(header.numPatterns * sizeof(double)));
+  const uint64_t *offsets = reinterpret_cast<const uint64_t *>(
+      sectionFcn((numLists + 1) * sizeof(uint64_t)));
+  const PatternIndex *entries = reinterpret_cast<const PatternIndex *>(
+      sectionFcn(header.numEntries * sizeof(PatternIndex)));
+  const RGBA *palette = reinterpret_cast<const RGBA *>(
+      sectionFcn(header.numColors * sizeof(RGBA)));
+  const ColorIndex *patterns = reinterpret_cast<const ColorIndex *>(
+      sectionFcn(header.numPatterns * n * n * sizeof(ColorIndex)));
+
+  // The lists must stay inside the entries, or operator[] reads past them
+  if (offsets[0] != 0 || offsets[numLists] != header.numEntries) {
+    return false;
+  }
+  for (size_t i = 0; i < numLists; ++i) {
+    if (offsets[i] > offsets[i + 1]) {
+      return false;
+    }
+  }
+
+  OverlappingModelInternal internal;
+  internal.foundation = header.foundation;
+  internal._n = static_cast<int>(n);
+  internal._palette.assign(palette, palette + header.numColors);
+  internal._patterns.reserve(header.numPatterns);
+  for (size_t t = 0; t < header.numPatterns; ++t) {
+    Pattern pattern({n, n});
+    std::copy(patterns + t * n * n, patterns + (t + 1) * n * n,
+              pattern.data());
+    internal._patterns.push_back(pattern);
+  }
+  // Keeps the file mapped for as long as the model is around
+  internal._propagator =
+      Propagator({header.numPatterns, side, side}, offsets, entries, file);
+
+  info.internal = std::move(internal);
+  info.commonParams.patternWeights.assign(weights,
+                                          weights + header.numPatterns);
+  return true;
+}
+
+bool saveCachedModel(const std::string &path, uint64_t key,
+                     const OverlappingComputedInfo &info) {
+  const OverlappingModelInternal &internal = info.internal;
+  const Propagator &propagator = internal._propagator;
+
+  ModelCacheHeader header = {};
+  std::memcpy(header.magic, kModelCacheMagic, sizeof(kModelCacheMagic));
+  header.version = kModelCacheVersion;
+  header.n = internal._n;
+  header.key = key;
+  header.foundation = internal.foundation;
+  header.numColors = internal._palette.size();
+  header.numPatterns = internal._patterns.size();
+  header.numEntries = propagator.numEntries();
+
+  createParentDirectory(path);
+  const std::string temporaryPath = path + ".tmp";
+  bool written;
+  {
+    std::ofstream stream(temporaryPath, std::ios::binary);
+    writeArray(stream, &header, 1);
+    writeArray(stream, info.commonParams.patternWeights.data(),
+               info.commonParams.patternWeights.size());
+    writeArray(stream, propagator.offsets().begin(),
+               propagator.offsets().size());
+    writeArray(stream, propagator.entries().begin(),
+               propagator.entries().size());
+    writeArray(stream, internal._palette.data(), internal._palette.size());
+    for (const Pattern &pattern : internal._patterns) {
+      writeArray(stream, pattern.data(), area(pattern.size()));
+    }
+    written = static_cast<bool>(stream);
+  }
+  if (!written) {
+    std::remove(temporaryPath.c_str());
+    return false;
+  }
+
+  if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+    // Windows doesn't replace an existing file
+    std::remove(path.c_str());
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+      std::remove(temporaryPath.c_str());
+      return false;
+    }
+  }
+  return true;
+}
@@ -1,9 +1,20 @@
 #include <wfc/overlapping_model.h>
+
+#include <wfc/algorithm.h>
+#include <wfc/model_cache.h>
 #include <wfc/overlapping_pattern_extraction.h>
+#include <wfc/pattern_size.h>
 #include <wfc/ranges.h>
+#include <wfc/stopwatch.h>
+
+#include <loguru.hpp>
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
 
 RGBA collapsePixel(const std::vector<ColorIndex> &tile_contributors,
                    const Palette &palette) {
@@ -51,7 +62,15 @@ Image image_from_graphics(const Graphics &graphics, const Palette &palette) {
   return result;
 }
 
-bool agrees(const Pattern &p1, const Pattern &p2, int dx, int dy, int n) {
+namespace {
+
+template <int N>
+bool agreesKernel(const Pattern &p1, const Pattern &p2, int dx, int dy,
+                  int runtimeN) {
+  const int n = patternSide<N>(runtimeN);
+  const ColorIndex *cells1 = p1.data();
+  const ColorIndex *cells2 = p2.data();
+
   int xmin, xmax, ymin, ymax;
 
   if (dx < 0) {
@@ -72,9 +91,9 @@ bool agrees(const Pattern &p1, const Pattern &p2, int dx, int dy, int n) {
     ymax = n;
   }
 
-  for (size_t y = ymin; y < ymax; ++y) {
-    for (size_t x = xmin; x < xmax; ++x) {
-      if (p1[{x, y}] != p2[{(x - dx), (y - dy)}]) {
+  for (int y = ymin; y < ymax; ++y) {
+    for (int x = xmin; x < xmax; ++x) {
+      if (cells1[y * n + x] != cells2[(y - dy) * n + (x - dx)]) {
         return false;
       }
     }
@@ -82,19 +101,78 @@ bool agrees(const Pattern &p1, const Pattern &p2, int dx, int dy, int n) {
   return true;
 }
 
+} // namespace
+
+bool agrees(const Pattern &p1, const Pattern &p2, int dx, int dy, int n) {
+  return dispatchPatternSize(n, [&](auto size) {
+    return agreesKernel<decltype(size)::value>(p1, p2, dx, dy, n);
+  });
+}
+
 OverlappingModel::OverlappingModel(const OverlappingComputedInfo &config)
-    : mInternal(config.internal) {
+    : OverlappingModel(config, choosePropagationEngine(config)) {}
+
+OverlappingModel::OverlappingModel(const OverlappingComputedInfo &config,
+                                   PropagationEngine engine)
+    : OverlappingModel(config, engine,
+                       chooseCompatibilityCheck(config.internal._propagator)) {
+}
+
+OverlappingModel::OverlappingModel(const OverlappingComputedInfo &config,
+                                   PropagationEngine engine,
+                                   CompatibilityCheck check)
+    : mInternal(config.internal), mEngine(engine), mCheck(check),
+      mNeighbourhood(
+          neighbourhoodOffsets(config.internal._n, config.neighbourhood)) {
   mCommonParams = config.commonParams;
+  if (mEngine == PropagationEngine::kRescan &&
+      mCheck == CompatibilityCheck::kMasks) {
+    mMasks = std::make_shared<const PropagatorMasks>(mInternal._propagator);
+  }
+  mInitialData = std::make_shared<const AlgorithmData>(buildInitialData());
 }
 
-OverlappingComputedInfo fromConfig(const OverlappingModelConfig &config) {
-  OverlappingComputedInfo toReturn;
+CompatibilityCheck chooseCompatibilityCheck(const Propagator &propagator) {
+  const size_t words = wordsForPatterns(propagator.size().width);
+  const size_t maskBytes = propagator.volume() * words * sizeof(WaveWord);
+  if (maskBytes > kMaxPropagatorMaskBytes) {
+    return CompatibilityCheck::kLists;
+  }
 
-  toReturn.commonParams.mOutputProperties = config.outputProperties;
+  PropagatorStatistics statistics = analyze(propagator);
+  return statistics.average >= words
+             ? CompatibilityCheck::kMasks
+             : CompatibilityCheck::kLists;
+}
+
+PropagationEngine choosePropagationEngine(const OverlappingComputedInfo &config) {
+  return choosePropagationEngine(
+      config.commonParams,
+      neighbourhoodOffsets(config.internal._n, config.neighbourhood).size());
+}
+
+std::vector<Offset2D> neighbourhoodOffsets(int n,
+                                           OverlapNeighbourhood neighbourhood) {
+  std::vector<Offset2D> toReturn;
+  const int rangeLimit = n - 1;
+  SquareRange range{{-rangeLimit, -rangeLimit}, {rangeLimit, rangeLimit}};
+  range2D(range)([&](const Offset2D &offset) {
+    if (neighbourhood == OverlapNeighbourhood::kWindow ||
+        std::abs(offset.x) + std::abs(offset.y) == 1) {
+      toReturn.push_back(offset);
+    }
+  });
+  return toReturn;
+}
+
+namespace {
 
-  toReturn.internal._n = config.n;
-  toReturn.internal._palette = config.sample_image.palette;
+void compileModel(const OverlappingModelConfig &config,
+                  OverlappingComputedInfo &info) {
+  info.internal._n = config.n;
+  info.internal._palette = config.sample_image.palette;
 
+  Stopwatch stopwatch;
   PatternInfo patternInfo =
       calculatePatternInfo(config.sample_image, config.hasfoundation,
                            config.periodic_in, config.symmetry, config.n);
@@ -104,7 +182,7 @@ OverlappingComputedInfo fromConfig(const OverlappingModelConfig &config) {
   for (const auto &pattern : patternInfo.patterns) {
     extractedWeights.push_back(pattern.weight);
   }
-  toReturn.commonParams.patternWeights = extractedWeights;
+  info.commonParams.patternWeights = extractedWeights;
 
   std::vector<Pattern> extractedPatterns;
   extractedPatterns.reserve(patternInfo.patterns.size());
@@ -112,43 +190,237 @@ OverlappingComputedInfo fromConfig(const OverlappingModelConfig &config) {
     extractedPatterns.push_back(pattern.pattern);
   }
 
-  toReturn.internal.foundation = patternInfo.foundation;
-  toReturn.internal._patterns = extractedPatterns;
+  info.internal.foundation = patternInfo.foundation;
+  info.internal._patterns = extractedPatterns;
+  info.buildStatistics.extractionSeconds = stopwatch.seconds();
+
+  stopwatch.restart();
+  info.internal._propagator = createPropagator(
+      info.internal._patterns.size(), config.n, info.internal._patterns);
+  info.buildStatistics.propagatorSeconds = stopwatch.seconds();
+}
+
+} // namespace
+
+OverlappingComputedInfo fromConfig(const OverlappingModelConfig &config) {
+  // Patterns are stored inline, so a larger n would write past them
+  CHECK_F(validPatternSide(config.n), "n = %d, must be between 1 and %zu",
+          config.n, kMaxPatternSide);
+
+  OverlappingComputedInfo toReturn;
+
+  toReturn.commonParams.mOutputProperties = config.outputProperties;
+  toReturn.neighbourhood = config.neighbourhood;
+
+  if (config.cache_dir.empty()) {
+    compileModel(config, toReturn);
+  } else {
+    uint64_t key = modelCacheKey(config);
+    std::string path = modelCachePath(config.cache_dir, key);
+    Stopwatch stopwatch;
+    toReturn.buildStatistics.fromCache = loadCachedModel(path, key, toReturn);
+    if (!toReturn.buildStatistics.fromCache) {
+      compileModel(config, toReturn);
+      stopwatch.restart();
+      saveCachedModel(path, key, toReturn);
+    }
+    toReturn.buildStatistics.cacheSeconds = stopwatch.seconds();
+  }
 
   toReturn.commonParams.numPatterns = toReturn.internal._patterns.size();
-//  LOG_F(INFO, "Found %lu unique patterns in sample image",
-//        toReturn.commonParams.numPatterns);
+  toReturn.commonParams.patternWeightLogWeights =
+      calculateWeightLogWeights(toReturn.commonParams.patternWeights);
+  return toReturn;
+}
+
+namespace {
+
+// Key of the cells two patterns share at some offset. For the specialised
+// sizes it holds every cell of a pattern and needs no allocation; the cells
+// past the overlap stay 0, and keys are only compared for one offset, where
+// they all have the same length.
+template <int N> struct OverlapKey {
+
+  using type = std::array<ColorIndex, N * N>;
+
+  struct Hasher {
+
+    size_t operator()(const type &key) const {
+      size_t toReturn = 14695981039346656037ull;
+      for (ColorIndex cell : key) {
+        toReturn = (toReturn ^ cell) * 1099511628211ull;
+      }
+      return toReturn;
+    }
+  };
+
+  static void push(type &key, size_t i, ColorIndex cell) { key[i] = cell; }
+};
+
+template <> struct OverlapKey<kAnyPatternSize> {
 
-  toReturn.internal._propagator = createPropagator(
-      toReturn.commonParams.numPatterns, config.n, toReturn.internal._patterns);
+  using type = std::string;
 
-  PropagatorStatistics statistics = analyze(toReturn.internal._propagator);
-//  LOG_F(INFO, "propagator length: mean/max/sum: %.1f, %lu, %lu",
-//        statistics.average, statistics.longest_propagator,
-//        statistics.sum_propagator);
+  using Hasher = std::hash<std::string>;
+
+  static void push(type &key, size_t, ColorIndex cell) {
+    key.push_back(static_cast<char>(cell));
+  }
+};
+
+// The cells of pattern which another pattern placed at offset (dx, dy)
+// overlaps, row by row. agrees(p1, p2, dx, dy) is exactly
+// overlapKey(p1, dx, dy, n) == overlapKey(p2, -dx, -dy, n).
+template <int N>
+typename OverlapKey<N>::type overlapKey(const Pattern &pattern, int dx,
+                                        int dy, int runtimeN) {
+  const int n = patternSide<N>(runtimeN);
+  const ColorIndex *cells = pattern.data();
+  typename OverlapKey<N>::type toReturn{};
+  size_t i = 0;
+  for (int y = std::max(0, dy); y < std::min(n, n + dy); ++y) {
+    for (int x = std::max(0, dx); x < std::min(n, n + dx); ++x) {
+      OverlapKey<N>::push(toReturn, i++, cells[y * n + x]);
+    }
+  }
   return toReturn;
 }
 
+} // namespace
+
 Propagator createPropagator(size_t numPatterns, size_t n,
-                            const std::vector<Pattern> &patterns) {
-  Dimension3D propagatorSize{numPatterns, 2 * n - 1, 2 * n - 1};
-  Propagator toReturn(propagatorSize, {});
+                            const std::vector<Pattern> &patterns,
+                            size_t numThreads) {
+  const size_t side = 2 * n - 1;
+  const size_t numOffsets = side * side;
+  const int rangeLimit = n - 1;
+  Dimension3D propagatorSize{numPatterns, side, side};
 
-  for (size_t t = 0; t < propagatorSize.width; ++t) {
-    for (size_t x = 0; x < propagatorSize.height; ++x) {
-      for (size_t y = 0; y < propagatorSize.depth; ++y) {
-        Index3D index3D{t, x, y};
+  // For offset k, the patterns t2 grouped by their overlapKey at -k, each
+  // group in t2 order, and the group of every pattern t's key at k (or -1
+  // if no pattern has it). The list of (t, k) is then the group of t.
+  struct OffsetGroups {
+
+    std::vector<std::vector<PatternIndex>> groups;
+
+    std::vector<int> groupOf;
+  };
+
+  std::vector<OffsetGroups> offsetGroups(numOffsets);
+  auto groupFcn = [&](auto size, size_t k) {
+    constexpr int N = decltype(size)::value;
+    using Key = OverlapKey<N>;
+    const int dx = static_cast<int>(k % side) - rangeLimit;
+    const int dy = static_cast<int>(k / side) - rangeLimit;
+    OffsetGroups &toFill = offsetGroups[k];
+
+    std::unordered_map<typename Key::type, int, typename Key::Hasher>
+        groupIndices;
+    for (size_t t2 = 0; t2 < numPatterns; ++t2) {
+      auto inserted = groupIndices.emplace(
+          overlapKey<N>(patterns[t2], -dx, -dy, n), toFill.groups.size());
+      if (inserted.second) {
+        toFill.groups.emplace_back();
+      }
+      toFill.groups[inserted.first->second].push_back(t2);
+    }
+
+    toFill.groupOf.resize(numPatterns);
+    for (size_t t = 0; t < numPatterns; ++t) {
+      auto found = groupIndices.find(overlapKey<N>(patterns[t], dx, dy, n));
+      toFill.groupOf[t] = (found == groupIndices.end()) ? -1 : found->second;
+    }
+  };
+  dispatchPatternSize(n, [&](auto size) {
+    parallelFor(
+        numOffsets, [&](size_t k) { groupFcn(size, k); }, numThreads);
+  });
+
+  Propagator toReturn(propagatorSize);
+  const std::vector<PatternIndex> none;
+  for (size_t t = 0; t < numPatterns; ++t) {
+    for (size_t k = 0; k < numOffsets; ++k) {
+      const OffsetGroups &groups = offsetGroups[k];
+      int group = groups.groupOf[t];
+      toReturn.appendList(group < 0 ? none : groups.groups[group]);
+    }
+  }
+  return toReturn;
+}
+
+Propagator createPropagatorPairwise(size_t numPatterns, size_t n,
+                                    const std::vector<Pattern> &patterns,
+                                    size_t numThreads) {
+  const size_t side = 2 * n - 1;
+  const size_t numOffsets = side * side;
+  const int rangeLimit = n - 1;
+  Dimension3D propagatorSize{numPatterns, side, side};
+
+  // A pattern t2 which agrees with t at offset k, k = y * side + x as stored
+  struct Hit {
 
-        auto &list = toReturn[index3D];
-        for (int t2 = 0; t2 < numPatterns; ++t2) {
-          if (agrees(patterns[t], patterns[t2], x - n + 1, y - n + 1, n)) {
-            list.push_back(t2);
+    PatternIndex t2;
+
+    uint16_t k;
+  };
+
+  // agrees(p1, p2, dx, dy) == agrees(p2, p1, -dx, -dy), so only the pairs
+  // with t <= t2 are tested. Row t gets its hits in t2 order, and the rows
+  // are independent, so they are shared out between the threads.
+  std::vector<std::vector<Hit>> rows(numPatterns);
+  auto rowFcn = [&](auto size, size_t t) {
+    constexpr int N = decltype(size)::value;
+    std::vector<Hit> &row = rows[t];
+    for (size_t t2 = t; t2 < numPatterns; ++t2) {
+      for (size_t y = 0; y < side; ++y) {
+        for (size_t x = 0; x < side; ++x) {
+          if (agreesKernel<N>(patterns[t], patterns[t2],
+                              static_cast<int>(x) - rangeLimit,
+                              static_cast<int>(y) - rangeLimit, n)) {
+            row.push_back({static_cast<PatternIndex>(t2),
+                           static_cast<uint16_t>(y * side + x)});
           }
         }
       }
     }
+  };
+  dispatchPatternSize(n, [&](auto size) {
+    parallelFor(
+        numPatterns, [&](size_t t) { rowFcn(size, t); }, numThreads);
+  });
+
+  // Every hit lands in the list of (t, k) and, mirrored, in that of
+  // (t2, -k). Filling rows in t order keeps every list sorted, as with the
+  // full T X T loop.
+  auto mirrorFcn = [&](size_t k) { return numOffsets - 1 - k; };
+
+  std::vector<uint64_t> offsets(propagatorSize.width * numOffsets + 1, 0);
+  for (size_t t = 0; t < numPatterns; ++t) {
+    for (const Hit &hit : rows[t]) {
+      ++offsets[t * numOffsets + hit.k + 1];
+      if (hit.t2 != t) {
+        ++offsets[hit.t2 * numOffsets + mirrorFcn(hit.k) + 1];
+      }
+    }
   }
-  return toReturn;
+  for (size_t i = 1; i < offsets.size(); ++i) {
+    offsets[i] += offsets[i - 1];
+  }
+
+  std::vector<PatternIndex> data(offsets.back());
+  std::vector<uint64_t> cursors(offsets.begin(), offsets.end() - 1);
+  for (size_t t = 0; t < numPatterns; ++t) {
+    for (const Hit &hit : rows[t]) {
+      data[cursors[t * numOffsets + hit.k]++] = hit.t2;
+      if (hit.t2 != t) {
+        data[cursors[hit.t2 * numOffsets + mirrorFcn(hit.k)]++] = t;
+      }
+    }
+    // Not needed any more
+    std::vector<Hit>().swap(rows[t]);
+  }
+
+  return Propagator(propagatorSize, std::move(offsets), std::move(data));
 }
 
 PropagatorStatistics analyze(const Propagator &propagator) {
@@ -162,7 +434,7 @@ PropagatorStatistics analyze(const Propagator &propagator) {
       for (size_t y = 0; y < dimensions.depth; ++y) {
         Index3D index3D{t, x, y};
 
-        auto &list = propagator[index3D];
+        Span<const PatternIndex> list = propagator[index3D];
         statistics.longest_propagator =
             std::max(statistics.longest_propagator, list.size());
         statistics.sum_propagator += list.size();
@@ -175,23 +447,116 @@ PropagatorStatistics analyze(const Propagator &propagator) {
   return statistics;
 }
 
-bool OverlappingModel::propagate(AlgorithmData &algorithmData) const {
-  bool did_change = false;
+void OverlappingModel::propagate(AlgorithmData &algorithmData) const {
+  if (mEngine == PropagationEngine::kSupportCounters) {
+    propagateSupportCounters(algorithmData);
+  } else {
+    propagateRescan(algorithmData);
+  }
+}
+
+// _supportCounts is laid out as width X height X offsets X patterns, cells in
+// range2D order and offsets in mNeighbourhood order. Entry (s, k, t) counts
+// the patterns left in the cell at s + k which overlap consistently with t
+// placed at s, i.e. the patterns of _propagator[{t, n - 1 + k.x, n - 1 + k.y}]
+// still in the wave there.
+void OverlappingModel::initSupportCounts(AlgorithmData &algorithmData) const {
+  const size_t numPatterns = mCommonParams.numPatterns;
+  const int rangeLimit = mInternal._n - 1;
+
+  // Every cell starts with the same counts, as every pattern is possible
+  std::vector<SupportCount> cellCounts;
+  cellCounts.reserve(mNeighbourhood.size() * numPatterns);
+  for (const Offset2D &offset : mNeighbourhood) {
+    for (size_t t = 0; t < numPatterns; ++t) {
+      Index3D propagatorIndex{t, static_cast<size_t>(rangeLimit + offset.x),
+                              static_cast<size_t>(rangeLimit + offset.y)};
+      cellCounts.push_back(mInternal._propagator[propagatorIndex].size());
+    }
+  }
+
+  std::vector<SupportCount> &counts = algorithmData._supportCounts;
+  counts.resize(area(mCommonParams.mOutputProperties.dimensions) *
+                cellCounts.size());
+  for (size_t c = 0; c < counts.size(); c += cellCounts.size()) {
+    std::copy(cellCounts.begin(), cellCounts.end(), counts.begin() + c);
+  }
+}
+
+// Calls functor(sIndex, count, t2) for every support count which the banned
+// pattern contributes to: the patterns t2 of the cells s around it which
+// overlap consistently with it.
+template <class Functor>
+void OverlappingModel::forEachSupported(const BannedPattern &banned,
+                                        AlgorithmData &algorithmData,
+                                        Functor functor) const {
   Dimension2D dimension = mCommonParams.mOutputProperties.dimensions;
+  const size_t numPatterns = mCommonParams.numPatterns;
+  const size_t numNeighbours = mNeighbourhood.size();
+  const int rangeLimit = mInternal._n - 1;
+
+  // The banned pattern supported the patterns of the cells around it:
+  // seen from a cell s = banned - k, it was at offset k.
+  for (size_t k = 0; k < numNeighbours; ++k) {
+    const Offset2D &offset = mNeighbourhood[k];
+    Index2D sIndex =
+        shiftWrapped(banned.index, {-offset.x, -offset.y}, dimension);
+
+    if (on_boundary(sIndex)) {
+      continue;
+    }
 
-  // This whole set of nested loops looks very similar to the one in graphics()
-  auto rangeFcn = [&](const Index2D &index) {
-    if (!algorithmData._changes[index]) {
-      return;
+    size_t cell = sIndex.y * dimension.width + sIndex.x;
+    SupportCount *counts =
+        &algorithmData._supportCounts[(cell * numNeighbours + k) * numPatterns];
+
+    // agrees(t2, banned, k) == agrees(banned, t2, -k)
+    Index3D propagatorIndex{banned.pattern,
+                            static_cast<size_t>(rangeLimit - offset.x),
+                            static_cast<size_t>(rangeLimit - offset.y)};
+    for (PatternIndex t2 : mInternal._propagator[propagatorIndex]) {
+      functor(sIndex, counts[t2], t2);
     }
+  }
+}
 
-    algorithmData._changes[index] = false;
+void OverlappingModel::propagateSupportCounters(
+    AlgorithmData &algorithmData) const {
+  while (!algorithmData._banStack.empty()) {
+    const BannedPattern banned = algorithmData._banStack.back();
+    algorithmData._banStack.pop_back();
+
+    forEachSupported(banned, algorithmData,
+                     [&](const Index2D &sIndex, SupportCount &count,
+                         PatternIndex t2) {
+                       // Counts of already banned patterns keep being
+                       // decremented, so every decrement can later be undone
+                       // one for one.
+                       if (--count == 0 && algorithmData._wave.get(sIndex, t2)) {
+                         ban(mCommonParams, algorithmData, sIndex, t2);
+                       }
+                     });
+  }
+}
 
-    int rangeLimit = mInternal._n - 1;
+void OverlappingModel::unpropagate(AlgorithmData &algorithmData,
+                                   const BannedPattern &banned) const {
+  if (mEngine != PropagationEngine::kSupportCounters) {
+    return;
+  }
+  forEachSupported(
+      banned, algorithmData,
+      [](const Index2D &, SupportCount &count, PatternIndex) { ++count; });
+}
 
-    SquareRange range{{-rangeLimit, -rangeLimit}, {rangeLimit, rangeLimit}};
+void OverlappingModel::propagateRescan(AlgorithmData &algorithmData) const {
+  Dimension2D dimension = mCommonParams.mOutputProperties.dimensions;
 
-    auto rangeIterator = range2D(range);
+  // Removes the patterns around a changed cell which no longer have any
+  // pattern left in it to overlap with.
+  // This whole set of nested loops looks very similar to the one in graphics()
+  auto reviseFcn = [&](const Index2D &index) {
+    int rangeLimit = mInternal._n - 1;
 
     auto rangeFcn = [&](const Offset2D &offset) {
       int sx = static_cast<int>(index.x) + static_cast<int>(offset.x);
@@ -216,51 +581,65 @@ bool OverlappingModel::propagate(AlgorithmData &algorithmData) const {
         return;
       }
 
-      for (size_t t2 = 0; t2 < mCommonParams.numPatterns; ++t2) {
-        Index3D sPatternIndex = append(sIndex, t2);
-        if (!algorithmData._wave[sPatternIndex]) {
-          continue;
-        }
-
+      auto patternFcn = [&](size_t t2) {
         // This part below seems to be the only thing fundamentally diff from
         // graphics() algorithm:
         bool can_pattern_fit = false;
 
         Index3D shiftedIndex{t2, static_cast<size_t>(rangeLimit - offset.x), static_cast<size_t>(rangeLimit - offset.y)};
-        const auto &prop = mInternal._propagator[shiftedIndex];
-        for (const auto &t3 : prop) {
-          if (algorithmData._wave[append(index, t3)]) {
-            can_pattern_fit = true;
-            break;
+        if (mMasks) {
+          can_pattern_fit =
+              algorithmData._wave.intersects(index, (*mMasks)[shiftedIndex]);
+        } else {
+          Span<const PatternIndex> prop = mInternal._propagator[shiftedIndex];
+          for (const auto &t3 : prop) {
+            if (algorithmData._wave.get(index, t3)) {
+              can_pattern_fit = true;
+              break;
+            }
           }
         }
 
         if (!can_pattern_fit) {
-          algorithmData._changes[sIndex] = true;
-          algorithmData._wave[sPatternIndex] = false;
-          did_change = true;
+          ban(mCommonParams, algorithmData, sIndex, t2);
         }
-      }
+      };
+
+      algorithmData._wave.forEachPattern(sIndex, patternFcn);
     };
 
-    rangeIterator(rangeFcn);
+    for (const Offset2D &offset : mNeighbourhood) {
+      rangeFcn(offset);
+    }
   };
 
-  runForDimension(dimension, rangeFcn);
-
-  return did_change;
+  // Each round revises the cells changed by the previous one
+  while (!algorithmData._banStack.empty()) {
+    for (const Index2D &index : takeChangedCells(algorithmData)) {
+      reviseFcn(index);
+    }
+  }
 }
 
 Graphics OverlappingModel::graphics(const AlgorithmData &algorithmData) const {
+  return dispatchPatternSize(mInternal._n, [&](auto size) {
+    return graphicsKernel<decltype(size)::value>(algorithmData);
+  });
+}
+
+template <int N>
+Graphics
+OverlappingModel::graphicsKernel(const AlgorithmData &algorithmData) const {
   Dimension2D dimension = mCommonParams.mOutputProperties.dimensions;
+  const int n = patternSide<N>(mInternal._n);
 
   Graphics result(dimension, {});
 
   auto rangeFcn = [&](const Index2D &index) {
     auto &tile_contributors = result[index];
 
-    for (int dy = 0; dy < mInternal._n; ++dy) {
-      for (int dx = 0; dx < mInternal._n; ++dx) {
+    for (int dy = 0; dy < n; ++dy) {
+      for (int dx = 0; dx < n; ++dx) {
         int sx = index.x - dx;
         if (sx < 0)
           sx += dimension.width;
@@ -273,12 +652,11 @@ Graphics OverlappingModel::graphics(const AlgorithmData &algorithmData) const {
           continue;
         }
 
-        for (size_t t = 0; t < mCommonParams.numPatterns; ++t) {
-          Index3D index3D{static_cast<size_t>(sx), static_cast<size_t>(sy), t};
-          if (algorithmData._wave[index3D]) {
-            tile_contributors.push_back(mInternal._patterns[t][{static_cast<size_t>(dx), static_cast<size_t>(dy)}]);
-          }
-        }
+        Index2D sIndex{static_cast<size_t>(sx), static_cast<size_t>(sy)};
+        algorithmData._wave.forEachPattern(sIndex, [&](size_t t) {
+          tile_contributors.push_back(
+              mInternal._patterns[t].data()[dy * n + dx]);
+        });
       }
     }
   };
@@ -311,43 +689,67 @@ std::unique_ptr<Image> upsample(const Image &image) {
 }
 
 AlgorithmData OverlappingModel::initAlgorithmData() const {
-  AlgorithmData algorithmData = initialOutput(
-      mCommonParams.mOutputProperties.dimensions, mCommonParams.numPatterns);
+  return *mInitialData;
+}
+
+AlgorithmData OverlappingModel::buildInitialData() const {
+  AlgorithmData algorithmData = initialOutput(mCommonParams);
+  if (mEngine == PropagationEngine::kSupportCounters) {
+    initSupportCounts(algorithmData);
+  }
+
+  // A pattern with nothing to overlap with at some offset (only possible with
+  // non-periodic input) can never be placed away from the boundary. Both
+  // engines would only notice once a neighbour changes, so remove it up front.
+  const int rangeLimit = mInternal._n - 1;
+  SquareRange range{{-rangeLimit, -rangeLimit}, {rangeLimit, rangeLimit}};
+  for (size_t t = 0; t < mCommonParams.numPatterns; ++t) {
+    bool placeable = true;
+    range2D(range)([&](const Offset2D &offset) {
+      Index3D propagatorIndex{t, static_cast<size_t>(rangeLimit + offset.x),
+                              static_cast<size_t>(rangeLimit + offset.y)};
+      placeable = placeable && !mInternal._propagator[propagatorIndex].empty();
+    });
+
+    if (!placeable) {
+      runForDimension(mCommonParams.mOutputProperties.dimensions,
+                      [&](const Index2D &index) {
+                        if (!on_boundary(index)) {
+                          ban(mCommonParams, algorithmData, index, t);
+                        }
+                      });
+    }
+  }
+
   if (mInternal.foundation) {
     // Tile has a clearly-defined "ground"/"foundation"
     modifyOutputForFoundation(mCommonParams, *this, mInternal.foundation,
                               algorithmData);
   }
 
+  propagate(algorithmData);
+
   return algorithmData;
 }
 
 void modifyOutputForFoundation(const CommonParams &commonParams,
                                const Model &model, size_t foundation,
                                AlgorithmData &algorithmData) {
-  Dimension2D dimension = algorithmData._changes.size();
+  Dimension2D dimension = algorithmData._wave.size();
   for (size_t x = 0; x < dimension.width; ++x) {
     // Setting the foundation section of the algorithmData wave only true for
     // foundation
     for (size_t t = 0; t < commonParams.numPatterns; ++t) {
       if (t != foundation) {
-        Index3D index{x, dimension.height - 1, t};
-        algorithmData._wave[index] = false;
+        ban(commonParams, algorithmData, {x, dimension.height - 1}, t);
       }
     }
 
     // Setting the rest of the algorithmData wave only true for not foundation
     for (size_t y = 0; y < dimension.height - 1; ++y) {
-      Index3D index{x, y, foundation};
-      algorithmData._wave[index] = false;
-    }
-
-    for (size_t y = 0; y < dimension.height; ++y) {
-      Index2D index{x, y};
-      algorithmData._changes[index] = true;
+      ban(commonParams, algorithmData, {x, y}, foundation);
     }
   }
 
-  while (model.propagate(algorithmData))
-    ;
+  model.propagate(algorithmData);
 }
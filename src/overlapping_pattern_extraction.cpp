@@ -1,9 +1,12 @@
 #include <wfc/overlapping_pattern_extraction.h>
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <iostream>
 
+#include <wfc/parallel.h>
+#include <wfc/pattern_size.h>
 #include <wfc/ranges.h>
 
 std::array<int, 4> shiftVector = {{0, 0, 1, 1}};
@@ -79,16 +82,19 @@ template <class Functor> Pattern make_pattern(size_t n, Functor fun) {
 }
 
 PatternInfo calculatePatternInfo(const PalettedImage &image, bool hasFoundation,
-                                 bool periodicIn, size_t symmetry, int n) {
+                                 bool periodicIn, size_t symmetry, int n,
+                                 size_t numThreads) {
   PatternInfo toReturn = {};
 
-  PatternHash foundation = kInvalidHash;
-  PatternHash *foundationPtr = (hasFoundation) ? &foundation : nullptr;
+  // Stays empty, matching no pattern, without a foundation
+  Pattern foundation;
+  Pattern *foundationPtr = (hasFoundation) ? &foundation : nullptr;
   const auto hashed_patterns =
-      extract_patterns(image, n, periodicIn, symmetry, foundationPtr);
+      extract_patterns(image, n, periodicIn, symmetry, foundationPtr,
+                       numThreads);
 
   for (const auto &it : hashed_patterns) {
-    if (it.first.hash == foundation) {
+    if (it.first.pattern == foundation) {
       // size() = the current index. This should be more explicit.
       // This is also a really roundabout way of setting the foundation
       toReturn.foundation = toReturn.patterns.size();
@@ -100,16 +106,322 @@ PatternInfo calculatePatternInfo(const PalettedImage &image, bool hasFoundation,
   return toReturn;
 }
 
+namespace {
+
+// Where the cells of the transforms of a pattern come from: cell i of
+// transform k is cell permutations[k][i] of the pattern as read from the
+// sample, with k enumerating {k / 2, k % 2} like the loop in extract_patterns.
+std::array<std::array<uint8_t, kMaxPatternSide * kMaxPatternSide>, 8>
+transformPermutations(int n) {
+  Pattern current({static_cast<size_t>(n), static_cast<size_t>(n)});
+  for (int i = 0; i < n * n; ++i) {
+    current.data()[i] = static_cast<ColorIndex>(i);
+  }
+
+  std::array<std::array<uint8_t, kMaxPatternSide * kMaxPatternSide>, 8>
+      toReturn{};
+  for (size_t rotations = 0; rotations < 4; ++rotations) {
+    Pattern reflected = reflect(current, n);
+    std::copy(current.data(), current.data() + n * n,
+              toReturn[2 * rotations].begin());
+    std::copy(reflected.data(), reflected.data() + n * n,
+              toReturn[2 * rotations + 1].begin());
+    current = rotate(current, n);
+  }
+  return toReturn;
+}
+
+// Key of the sample window at the current position, which can be moved one
+// column to the right without reading the whole window again. Exact: equal
+// keys mean equal windows.
+template <int N> class PackedWindowKey {
+
+public:
+  using Key = PackedPatternKey;
+
+  using Hasher = PackedPatternKey::Hasher;
+
+  static const bool kExact = true;
+
+  PackedWindowKey(const PalettedImage &sample, int runtimeN)
+      : mSample(sample), mN(patternSide<N>(runtimeN)),
+        mBits(bitsPerColor(sample.palette.size())) {}
+
+  void start(const Index2D &index) {
+    mKey = {};
+    mIndex = index;
+    for (int x = 0; x < mN; ++x) {
+      addColumn(x, (index.x + x) % mSample.data.size().width);
+    }
+  }
+
+  // Drops the first column and reads the one after the last.
+  void next() {
+    shiftRight(mBits * mN);
+    ++mIndex.x;
+    addColumn(mN - 1, (mIndex.x + mN - 1) % mSample.data.size().width);
+  }
+
+  const Key &key() const { return mKey; }
+
+private:
+  void addColumn(int x, size_t sx) {
+    const Dimension2D dimension = mSample.data.size();
+    const ColorIndex *pixels = mSample.data.data();
+    for (int y = 0; y < mN; ++y) {
+      size_t sy = (mIndex.y + y) % dimension.height;
+      addBits(pixels[sy * dimension.width + sx], (x * mN + y) * mBits);
+    }
+  }
+
+  void addBits(uint64_t value, size_t offset) {
+    if (offset < 64) {
+      mKey.low |= value << offset;
+      // Straddling both words
+      if (offset + mBits > 64) {
+        mKey.high |= value >> (64 - offset);
+      }
+    } else {
+      mKey.high |= value << (offset - 64);
+    }
+  }
+
+  void shiftRight(size_t bits) {
+    if (bits >= 64) {
+      mKey.low = mKey.high >> (bits - 64);
+      mKey.high = 0;
+    } else {
+      mKey.low = (mKey.low >> bits) | (mKey.high << (64 - bits));
+      mKey.high >>= bits;
+    }
+  }
+
+  const PalettedImage &mSample;
+
+  const int mN;
+
+  const size_t mBits;
+
+  Index2D mIndex;
+
+  PackedPatternKey mKey;
+};
+
+// Rabin-Karp hash of the sample window at the current position, for windows
+// too large for PackedWindowKey: a hash of every column of the window, in
+// base kColumnBase, combined in base kRowBase. Moving right takes one column
+// hash out and one in. Different windows may share a hash.
+template <int N> class RollingWindowHash {
+
+public:
+  using Key = uint64_t;
+
+  using Hasher = std::hash<uint64_t>;
+
+  static const bool kExact = false;
+
+  RollingWindowHash(const PalettedImage &sample, int runtimeN)
+      : mSample(sample), mN(patternSide<N>(runtimeN)), mFirstColumnPower(1) {
+    for (int i = 1; i < mN; ++i) {
+      mFirstColumnPower *= kRowBase;
+    }
+  }
+
+  void start(const Index2D &index) {
+    mKey = 0;
+    mIndex = index;
+    for (int x = 0; x < mN; ++x) {
+      mKey = mKey * kRowBase +
+             columnHash((index.x + x) % mSample.data.size().width);
+    }
+  }
+
+  void next() {
+    const size_t width = mSample.data.size().width;
+    mKey -= columnHash(mIndex.x % width) * mFirstColumnPower;
+    ++mIndex.x;
+    mKey = mKey * kRowBase + columnHash((mIndex.x + mN - 1) % width);
+  }
+
+  const Key &key() const { return mKey; }
+
+private:
+  static const uint64_t kColumnBase = 0x100000001b3ull;
+
+  static const uint64_t kRowBase = 0x9e3779b97f4a7c15ull;
+
+  uint64_t columnHash(size_t sx) const {
+    const Dimension2D dimension = mSample.data.size();
+    const ColorIndex *pixels = mSample.data.data();
+    uint64_t toReturn = 0;
+    for (int y = 0; y < mN; ++y) {
+      size_t sy = (mIndex.y + y) % dimension.height;
+      toReturn = toReturn * kColumnBase + pixels[sy * dimension.width + sx] + 1;
+    }
+    return toReturn;
+  }
+
+  const PalettedImage &mSample;
+
+  const int mN;
+
+  uint64_t mFirstColumnPower;
+
+  Index2D mIndex;
+
+  uint64_t mKey;
+};
+
+// A kind of window found in the sample, with the patterns its transforms
+// were counted under. Windows with the same non-exact key are chained
+// through next.
+struct SeenWindow {
+
+  Index2D firstIndex;
+
+  std::array<PatternPrevalence::value_type *, 8> patterns;
+
+  size_t next;
+};
+
+const size_t kNoWindow = -1;
+
+// Number of bands of rows the windows of dimension are split into.
+size_t numBands(const Dimension2D &dimension, size_t numThreads) {
+  return std::max<size_t>(
+      1, std::min(numThreads, area(dimension) / kMinBandPixels));
+}
+
+// First row of band b, and one past the last row of band b - 1.
+size_t bandStart(size_t height, size_t numBands, size_t b) {
+  return b * height / numBands;
+}
+
+// The patterns of a band of rows of the sample.
+struct BandPatterns {
+
+  PatternPrevalence patterns;
+
+  // In the order they were first seen, i.e. inserted.
+  std::vector<const PatternPrevalence::value_type *> order;
+
+  // The last pattern taken from the bottom row of the sample, if the band
+  // holds it.
+  const Pattern *lowest = nullptr;
+};
+
+template <int N, class WindowKey>
+void extractPatternsKernel(const PalettedImage &sample, int runtimeN,
+                           const Dimension2D &dimension, size_t firstRow,
+                           size_t lastRow, size_t symmetry,
+                           BandPatterns &band) {
+  PatternPrevalence &patterns = band.patterns;
+  const int n = patternSide<N>(runtimeN);
+  const Dimension2D imageDimension = sample.data.size();
+  const ColorIndex *pixels = sample.data.data();
+  const auto permutations = transformPermutations(n);
+
+  auto cellFcn = [&](const Index2D &index, int i) {
+    size_t sx = (index.x + i % n) % imageDimension.width;
+    size_t sy = (index.y + i / n) % imageDimension.height;
+    return pixels[sy * imageDimension.width + sx];
+  };
+
+  auto sameWindowFcn = [&](const Index2D &left, const Index2D &right) {
+    for (int i = 0; i < n * n; ++i) {
+      if (cellFcn(left, i) != cellFcn(right, i)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  // Counted in the order the patterns are first seen, which decides the
+  // order PatternPrevalence iterates them in
+  auto addWindowFcn = [&](const Index2D &index) {
+    SeenWindow toReturn{index, {}, kNoWindow};
+    for (size_t k = 0; k < symmetry; ++k) {
+      Pattern pattern({static_cast<size_t>(n), static_cast<size_t>(n)});
+      for (int i = 0; i < n * n; ++i) {
+        pattern.data()[i] = cellFcn(index, permutations[k][i]);
+      }
+      HashedPattern hashedPattern{
+          pattern, hash_from_pattern(pattern, sample.palette.size())};
+      auto inserted = patterns.emplace(hashedPattern, 0);
+      toReturn.patterns[k] = &*inserted.first;
+      if (inserted.second) {
+        band.order.push_back(toReturn.patterns[k]);
+      }
+    }
+    return toReturn;
+  };
+
+  std::vector<SeenWindow> windows;
+  std::unordered_map<typename WindowKey::Key, size_t,
+                     typename WindowKey::Hasher>
+      firstWithKey;
+
+  WindowKey windowKey(sample, n);
+  for (size_t y = firstRow; y < lastRow; ++y) {
+    windowKey.start({0, y});
+    for (size_t x = 0; x < dimension.width; ++x) {
+      if (x > 0) {
+        windowKey.next();
+      }
+      const Index2D index{x, y};
+
+      auto first = firstWithKey.find(windowKey.key());
+      size_t slot = first == firstWithKey.end() ? kNoWindow : first->second;
+      size_t last = kNoWindow;
+      while (!WindowKey::kExact && slot != kNoWindow &&
+             !sameWindowFcn(windows[slot].firstIndex, index)) {
+        last = slot;
+        slot = windows[slot].next;
+      }
+
+      if (slot == kNoWindow) {
+        slot = windows.size();
+        if (last != kNoWindow) {
+          windows[last].next = slot;
+        } else {
+          firstWithKey.emplace(windowKey.key(), slot);
+        }
+        windows.push_back(addWindowFcn(index));
+      }
+
+      const SeenWindow &window = windows[slot];
+      for (size_t k = 0; k < symmetry; ++k) {
+        window.patterns[k]->second += 1;
+      }
+
+      if (y == imageDimension.height - 1) {
+        band.lowest = &window.patterns[symmetry - 1]->first.pattern;
+      }
+    }
+  }
+}
+
+} // namespace
+
+size_t bitsPerColor(size_t palette_size) {
+  size_t toReturn = 1;
+  while ((size_t(1) << toReturn) < palette_size) {
+    ++toReturn;
+  }
+  return toReturn;
+}
+
+bool fitsPackedKey(int n, size_t palette_size) {
+  return n * n * bitsPerColor(palette_size) <= 128;
+}
+
 // n = side of the pattern, e.g. 3.
 PatternPrevalence extract_patterns(const PalettedImage &sample, int n,
                                    bool periodic_in, size_t symmetry,
-                                   PatternHash *out_lowest_pattern) {
+                                   Pattern *out_lowest_pattern,
+                                   size_t numThreads) {
   Dimension2D imageDimension = sample.data.size();
 
-  std::unordered_map<HashedPattern, size_t, PatternHasher> newPatterns;
-
-  PatternPrevalence patterns;
-
   Dimension2D dimension;
   if (periodic_in) {
     dimension = imageDimension;
@@ -117,24 +429,53 @@ PatternPrevalence extract_patterns(const PalettedImage &sample, int n,
     dimension = {imageDimension.width - n + 1, imageDimension.height - n + 1};
   }
 
-  auto rangeFcn = [&](const Index2D &index) {
-    Array2D<Pattern> ps = generatePatterns(sample, n, index);
-    for (size_t k = 0; k < symmetry; ++k) {
-      Index2D transformIndex = {k / 2, (k % 2) == 1};
-      HashedPattern hashedPattern{
-          ps[transformIndex],
-          hash_from_pattern(ps[transformIndex], sample.palette.size())};
-      patterns[hashedPattern] += 1;
-
-      if (out_lowest_pattern && index.y == imageDimension.height - 1) {
-        *out_lowest_pattern = hashedPattern.hash;
+  const size_t bands = numBands(dimension, numThreads);
+  std::vector<BandPatterns> bandPatterns(bands);
+  const bool packed = fitsPackedKey(n, sample.palette.size());
+  dispatchPatternSize(n, [&](auto size) {
+    constexpr int N = decltype(size)::value;
+    auto bandFcn = [&](size_t b) {
+      size_t firstRow = bandStart(dimension.height, bands, b);
+      size_t lastRow = bandStart(dimension.height, bands, b + 1);
+      if (packed) {
+        extractPatternsKernel<N, PackedWindowKey<N>>(
+            sample, n, dimension, firstRow, lastRow, symmetry,
+            bandPatterns[b]);
+      } else {
+        extractPatternsKernel<N, RollingWindowHash<N>>(
+            sample, n, dimension, firstRow, lastRow, symmetry,
+            bandPatterns[b]);
       }
+    };
+    parallelFor(bands, bandFcn, numThreads);
+  });
+
+  // Inserting the patterns new to each band after those of the bands above
+  // repeats the inserts of a single pass, so the map is built the same way
+  const Pattern *lowest = nullptr;
+  PatternPrevalence toReturn = std::move(bandPatterns[0].patterns);
+  for (size_t b = 0; b < bands; ++b) {
+    const BandPatterns &band = bandPatterns[b];
+    if (band.lowest) {
+      lowest = band.lowest;
     }
-  };
-
-  runForDimension(dimension, rangeFcn);
+    if (b == 0) {
+      continue;
+    }
+    for (const PatternPrevalence::value_type *pattern : band.order) {
+      auto found = toReturn.find(pattern->first);
+      if (found == toReturn.end()) {
+        toReturn.emplace(pattern->first, pattern->second);
+      } else {
+        found->second += pattern->second;
+      }
+    }
+  }
 
-  return patterns;
+  if (out_lowest_pattern && lowest) {
+    *out_lowest_pattern = *lowest;
+  }
+  return toReturn;
 }
 
 // A map from hashed pattern to the index in vector
@@ -163,58 +504,155 @@ auto runOverPatterns(const PalettedImage &sample, int n, const Index2D &index) {
 
       currentPattern = rotate(currentPattern, n);
     }
+    return false;
   };
 }
 
-ImagePatternProperties extractPatternsFromImage(const PalettedImage &sample,
-                                                int n) {
-  ImagePatternProperties toReturn;
-  toReturn.grid = Array2D<PatternIdentifier>(sample.data.size());
+namespace {
 
-  PatternMap patternMap;
+// The first of ps, in range2D order, held by patternMap. Sets transform to
+// its index in ps.
+PatternMap::const_iterator findTransform(const PatternMap &patternMap,
+                                         const PatternTransforms &ps,
+                                         size_t palette_size,
+                                         Index2D &transform) {
+  auto toReturn = patternMap.end();
 
-  // int count = 0;
+  auto consumerFcn = [&](const Index2D &index) {
+    const auto &pattern = ps[index];
+    HashedPattern hashedPattern{pattern,
+                                hash_from_pattern(pattern, palette_size)};
 
-  auto rangeFcn = [&](const Index2D &index) {
-    Array2D<Pattern> ps = generatePatterns(sample, n, index);
+    toReturn = patternMap.find(hashedPattern);
+    transform = index;
 
-    auto hashedValue = patternMap.end();
-    Index2D transformEnumeration = {0, 0};
+    return toReturn != patternMap.end();
+  };
 
-    auto consumerFcn = [&](const Index2D &index) {
-      const auto &pattern = ps[index];
-      HashedPattern hashedPattern{
-          pattern, hash_from_pattern(pattern, sample.palette.size())};
+  BreakRange::runForDimension(ps.size(), consumerFcn);
+  return toReturn;
+}
 
-      hashedValue = patternMap.find(hashedPattern);
-      transformEnumeration = index;
+} // namespace
 
-      return hashedValue != patternMap.end();
-    };
+ImagePatternProperties extractPatternsFromImage(const PalettedImage &sample,
+                                                int n, size_t numThreads) {
+  ImagePatternProperties toReturn;
+  toReturn.grid = Array2D<PatternIdentifier>(sample.data.size());
+
+  Dimension2D imageDimension = sample.data.size();
+  const size_t paletteSize = sample.palette.size();
 
-    Dimension2D transformDimensions = ps.size();
-    BreakRange::runForDimension(transformDimensions, consumerFcn);
+  PatternMap patternMap;
 
-    if (hashedValue != patternMap.end()) {
-      PatternIdentifier identifier{hashedValue->second, transformEnumeration};
-      toReturn.grid[index] = identifier;
+  auto addPatternFcn = [&](const Pattern &pattern) {
+    toReturn.patterns.push_back({pattern, Array2D<int>({4, 2}, 0)});
 
-      toReturn.patterns[hashedValue->second].occurrence[transformEnumeration]++;
-    } else {
-      toReturn.patterns.push_back({ps[{0, 0}], Array2D<int>({4, 2}, 0)});
-      toReturn.patterns.back().occurrence[{0, 0}] = 1;
+    HashedPattern hashedPattern{pattern,
+                                hash_from_pattern(pattern, paletteSize)};
+    patternMap[hashedPattern] = toReturn.patterns.size() - 1;
+  };
 
-      PatternIdentifier identifier{toReturn.patterns.size() - 1, {0, 0}};
-      toReturn.grid[index] = identifier;
+  const size_t bands = numBands(imageDimension, numThreads);
+  if (bands == 1) {
+    auto rangeFcn = [&](const Index2D &index) {
+      PatternTransforms ps = generatePatterns(sample, n, index);
+
+      Index2D transformEnumeration = {0, 0};
+      auto hashedValue =
+          findTransform(patternMap, ps, paletteSize, transformEnumeration);
+
+      if (hashedValue != patternMap.end()) {
+        PatternIdentifier identifier{hashedValue->second, transformEnumeration};
+        toReturn.grid[index] = identifier;
+
+        toReturn.patterns[hashedValue->second]
+            .occurrence[transformEnumeration]++;
+      } else {
+        addPatternFcn(ps[{0, 0}]);
+        toReturn.patterns.back().occurrence[{0, 0}] = 1;
+        toReturn.grid[index] = {toReturn.patterns.size() - 1, {0, 0}};
+      }
+    };
 
-      HashedPattern hashedPattern{
-          ps[{0, 0}], hash_from_pattern(ps[{0, 0}], sample.palette.size())};
-      patternMap[hashedPattern] = identifier.patternIndex;
+    runForDimension(imageDimension, rangeFcn);
+    return toReturn;
+  }
+
+  auto bandFcn = [&](size_t b, auto pixelFcn) {
+    size_t lastRow = bandStart(imageDimension.height, bands, b + 1);
+    for (size_t y = bandStart(imageDimension.height, bands, b); y < lastRow;
+         ++y) {
+      for (size_t x = 0; x < imageDimension.width; ++x) {
+        pixelFcn(Index2D{x, y});
+      }
     }
   };
 
-  Dimension2D imageDimension = sample.data.size();
-  runForDimension(imageDimension, rangeFcn);
+  // A pattern is added by the first pixel none of whose transforms is there
+  // yet. Those of a band are added in row order after the ones of the bands
+  // above, as a single pass would.
+  std::vector<std::vector<Index2D>> firstPixels(bands);
+  parallelFor(
+      bands,
+      [&](size_t b) {
+        PatternMap bandMap;
+        bandFcn(b, [&](const Index2D &index) {
+          PatternTransforms ps = generatePatterns(sample, n, index);
+          Index2D transformEnumeration;
+          if (findTransform(bandMap, ps, paletteSize, transformEnumeration) ==
+              bandMap.end()) {
+            HashedPattern hashedPattern{
+                ps[{0, 0}], hash_from_pattern(ps[{0, 0}], paletteSize)};
+            bandMap[hashedPattern] = firstPixels[b].size();
+            firstPixels[b].push_back(index);
+          }
+        });
+      },
+      numThreads);
+
+  for (const std::vector<Index2D> &pixels : firstPixels) {
+    for (const Index2D &index : pixels) {
+      PatternTransforms ps = generatePatterns(sample, n, index);
+      Index2D transformEnumeration;
+      if (findTransform(patternMap, ps, paletteSize, transformEnumeration) ==
+          patternMap.end()) {
+        addPatternFcn(ps[{0, 0}]);
+      }
+    }
+  }
+
+  // Only one transform of each pattern is in patternMap, so the first one
+  // found is the one a single pass would have found
+  const size_t numPatterns = toReturn.patterns.size();
+  std::vector<std::vector<int>> occurrences(bands);
+  parallelFor(
+      bands,
+      [&](size_t b) {
+        std::vector<int> &occurrence = occurrences[b];
+        occurrence.assign(numPatterns * 8, 0);
+        bandFcn(b, [&](const Index2D &index) {
+          PatternTransforms ps = generatePatterns(sample, n, index);
+          Index2D transformEnumeration;
+          size_t patternIndex =
+              findTransform(patternMap, ps, paletteSize, transformEnumeration)
+                  ->second;
+          toReturn.grid[index] = {patternIndex, transformEnumeration};
+          ++occurrence[patternIndex * 8 + transformEnumeration.y * 4 +
+                       transformEnumeration.x];
+        });
+      },
+      numThreads);
+
+  for (size_t t = 0; t < numPatterns; ++t) {
+    Array2D<int> &occurrence = toReturn.patterns[t].occurrence;
+    runForDimension(occurrence.size(), [&](const Index2D &transform) {
+      for (const std::vector<int> &bandOccurrence : occurrences) {
+        occurrence[transform] +=
+            bandOccurrence[t * 8 + transform.y * 4 + transform.x];
+      }
+    });
+  }
 
   return toReturn;
 }
@@ -233,9 +671,9 @@ PatternHash hash_from_pattern(const Pattern &pattern, size_t palette_size) {
   return result;
 }
 
-Array2D<Pattern> generatePatterns(const PalettedImage &sample, int n,
-                                  const Index2D &index) {
-  Array2D<Pattern> toReturn({4, 2});
+PatternTransforms generatePatterns(const PalettedImage &sample, int n,
+                                   const Index2D &index) {
+  PatternTransforms toReturn;
   auto consumerFcn = [&toReturn](const EnumeratedPattern &enumeratedPattern) {
     toReturn[enumeratedPattern.enumeratedTransform] = enumeratedPattern.pattern;
     return false;
@@ -248,29 +686,69 @@ Array2D<Pattern> generatePatterns(const PalettedImage &sample, int n,
   return toReturn;
 }
 
+namespace {
+
+// make_pattern for the kernels below: reads the cells in storage order, and
+// for the specialised sizes the loops have constant bounds.
+template <int N, class Functor>
+Pattern makePatternKernel(int runtimeN, Functor fun) {
+  const int n = patternSide<N>(runtimeN);
+  Pattern result({static_cast<size_t>(n), static_cast<size_t>(n)});
+  ColorIndex *cells = result.data();
+  for (int y = 0; y < n; ++y) {
+    for (int x = 0; x < n; ++x) {
+      cells[y * n + x] = fun(x, y);
+    }
+  }
+  return result;
+}
+
+template <int N>
+Pattern patternFromSampleKernel(const PalettedImage &sample, int runtimeN,
+                                const Index2D &imageIndex) {
+  Dimension2D dimension = sample.data.size();
+  const ColorIndex *pixels = sample.data.data();
+  return makePatternKernel<N>(runtimeN, [&](int x, int y) {
+    size_t sx = (imageIndex.x + x) % dimension.width;
+    size_t sy = (imageIndex.y + y) % dimension.height;
+    return pixels[sy * dimension.width + sx];
+  });
+}
+
+template <int N> Pattern rotateKernel(const Pattern &p, int runtimeN) {
+  const int n = patternSide<N>(runtimeN);
+  const ColorIndex *cells = p.data();
+  return makePatternKernel<N>(
+      n, [&](int x, int y) { return cells[((n - 1) - x) * n + y]; });
+}
+
+template <int N> Pattern reflectKernel(const Pattern &p, int runtimeN) {
+  const int n = patternSide<N>(runtimeN);
+  const ColorIndex *cells = p.data();
+  return makePatternKernel<N>(
+      n, [&](int x, int y) { return cells[y * n + (n - 1) - x]; });
+}
+
+} // namespace
+
 Pattern patternFromSample(const PalettedImage &sample, int n,
                           const Index2D &imageIndex) {
-  auto functor = [&](const Index2D &patternIndex) {
-    Index2D shiftedIndex = patternIndex + imageIndex;
-    Dimension2D dimension = sample.data.size();
-    auto index = wrapAroundIndex(shiftedIndex, dimension);
-    return sample.data[index];
-  };
-  return make_pattern(n, functor);
+  return dispatchPatternSize(n, [&](auto size) {
+    return patternFromSampleKernel<decltype(size)::value>(sample, n,
+                                                          imageIndex);
+  });
 }
 
 Pattern rotate(const Pattern &p, int n) {
-  auto functor = [&](const Index2D &patternIndex) {
-    return p[{patternIndex.y, (n - 1) - patternIndex.x}];
-  };
-  return make_pattern(n, functor);
+  return dispatchPatternSize(n, [&](auto size) {
+    return rotateKernel<decltype(size)::value>(p, n);
+  });
 }
 
 Pattern reflect(const Pattern &p, int n) {
-  auto functor = [&](const Index2D &patternIndex) {
-    return p[{(n - 1) - patternIndex.x, patternIndex.y}];
-  };
-  return make_pattern(n, functor);
+  return dispatchPatternSize(n, [&](auto size) {
+    return reflectKernel<decltype(size)::value>(p, n);
+  });
 }
 
 Index2D wrapAroundIndex(const Index2D &index, const Dimension2D &dimension) {
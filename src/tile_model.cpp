@@ -1,90 +1,186 @@
 #include <wfc/tile_model.h>
 
+#include <wfc/algorithm.h>
+#include <wfc/ranges.h>
+#include <wfc/stopwatch.h>
+
 #include <array>
 #include <cassert>
 #include <unordered_map>
 
-TileModel::TileModel(const TileModelInternal &internal) : mInternal(internal) {
+TileModel::TileModel(const TileModelInternal &internal)
+    : TileModel(internal, choosePropagationEngine(internal)) {}
+
+TileModel::TileModel(const TileModelInternal &internal,
+                     PropagationEngine engine)
+    : mInternal(internal), mEngine(engine) {
   // Needed because other functions access from base class
   // TODO: Remove
   mCommonParams = mInternal.mCommonParams;
+  mInitialData = std::make_shared<const AlgorithmData>(buildInitialData());
+}
+
+PropagationEngine choosePropagationEngine(const TileModelInternal &config) {
+  return choosePropagationEngine(config.mCommonParams, 4);
 }
 
 bool TileModel::on_boundary(const Index2D &index) const { return false; }
 
-bool TileModel::propagate(AlgorithmData &algorithmData) const {
-  bool did_change = false;
+// In direction d the neighbour is:
+// 0: to the right, 1: above, 2: to the left, 3: below
+bool TileModel::neighbor(const Index2D &index, size_t d,
+                         Index2D &toReturn) const {
+  static const Offset2D kDirections[4] = {{1, 0}, {0, -1}, {-1, 0}, {0, 1}};
+  Dimension2D dimension = mCommonParams.mOutputProperties.dimensions;
+  const Offset2D &direction = kDirections[d];
+
+  if (!mCommonParams.mOutputProperties.periodic) {
+    int x = static_cast<int>(index.x) + direction.x;
+    int y = static_cast<int>(index.y) + direction.y;
+    if (x < 0 || y < 0 || x >= static_cast<int>(dimension.width) ||
+        y >= static_cast<int>(dimension.height)) {
+      return false;
+    }
+  }
+
+  toReturn = shiftWrapped(index, direction, dimension);
+  return true;
+}
+
+void TileModel::propagate(AlgorithmData &algorithmData) const {
+  if (mEngine == PropagationEngine::kSupportCounters) {
+    propagateSupportCounters(algorithmData);
+  } else {
+    propagateRescan(algorithmData);
+  }
+}
+
+// _supportCounts is laid out as width X height X 4 X patterns, cells in
+// range2D order. Entry (c2, d, t2) counts the tiles t1 left in the cell c1
+// which has c2 next to it in direction d, with _propagator[{d, t1, t2}] set.
+void TileModel::initSupportCounts(AlgorithmData &algorithmData) const {
+  const size_t numPatterns = mCommonParams.numPatterns;
+
+  // Every cell starts with the same counts, as every tile is possible
+  std::vector<SupportCount> cellCounts(4 * numPatterns, 0);
+  for (size_t d = 0; d < 4; ++d) {
+    for (size_t t1 = 0; t1 < numPatterns; ++t1) {
+      for (PatternIndex t2 : mInternal._compatible[{d, t1}]) {
+        ++cellCounts[d * numPatterns + t2];
+      }
+    }
+  }
+
+  std::vector<SupportCount> &counts = algorithmData._supportCounts;
+  counts.resize(area(mCommonParams.mOutputProperties.dimensions) *
+                cellCounts.size());
+  for (size_t c = 0; c < counts.size(); c += cellCounts.size()) {
+    std::copy(cellCounts.begin(), cellCounts.end(), counts.begin() + c);
+  }
+}
 
+// Calls functor(index2, count, t2) for every support count which the banned
+// tile contributes to: the tiles t2 next to it which it allows there.
+template <class Functor>
+void TileModel::forEachSupported(const BannedPattern &banned,
+                                 AlgorithmData &algorithmData,
+                                 Functor functor) const {
   Dimension2D dimension = mCommonParams.mOutputProperties.dimensions;
+  const size_t numPatterns = mCommonParams.numPatterns;
 
-  for (size_t x2 = 0; x2 < dimension.width; ++x2) {
-    for (size_t y2 = 0; y2 < dimension.height; ++y2) {
-      for (size_t d = 0; d < 4; ++d) {
-        size_t x1 = x2, y1 = y2;
+  for (size_t d = 0; d < 4; ++d) {
+    Index2D index2;
+    if (!neighbor(banned.index, d, index2)) {
+      continue;
+    }
 
-        // Looks like this might be wrap-around algorithm?
-        if (d == 0) {
-          if (x2 == 0) {
-            if (!mCommonParams.mOutputProperties.periodic) {
-              continue;
-            }
-            x1 = dimension.width - 1;
-          } else {
-            x1 = x2 - 1;
-          }
-        } else if (d == 1) {
-          if (y2 == dimension.height - 1) {
-            if (!mCommonParams.mOutputProperties.periodic) {
-              continue;
-            }
-            y1 = 0;
-          } else {
-            y1 = y2 + 1;
-          }
-        } else if (d == 2) {
-          if (x2 == dimension.width - 1) {
-            if (!mCommonParams.mOutputProperties.periodic) {
-              continue;
-            }
-            x1 = 0;
-          } else {
-            x1 = x2 + 1;
-          }
-        } else {
-          if (y2 == 0) {
-            if (!mCommonParams.mOutputProperties.periodic) {
-              continue;
-            }
-            y1 = dimension.height - 1;
-          } else {
-            y1 = y2 - 1;
-          }
-        }
+    size_t cell = index2.y * dimension.width + index2.x;
+    SupportCount *counts =
+        &algorithmData._supportCounts[(cell * 4 + d) * numPatterns];
 
-        if (!algorithmData._changes[{x1, y1}]) {
-          continue;
-        }
+    for (PatternIndex t2 : mInternal._compatible[{d, banned.pattern}]) {
+      functor(index2, counts[t2], t2);
+    }
+  }
+}
 
-        for (size_t t2 = 0; t2 < mCommonParams.numPatterns; ++t2) {
-          if (algorithmData._wave[{x2, y2, t2}]) {
-            bool b = false;
-            for (size_t t1 = 0; t1 < mCommonParams.numPatterns && !b; ++t1) {
-              if (algorithmData._wave[{x1, y1, t1}]) {
-                b = mInternal._propagator[{d, t1, t2}];
-              }
-            }
-            if (!b) {
-              algorithmData._wave[{x2, y2, t2}] = false;
-              algorithmData._changes[{x2, y2}] = true;
-              did_change = true;
-            }
+void TileModel::propagateSupportCounters(AlgorithmData &algorithmData) const {
+  const ParallelPropagation &parallel = mInternal.parallelPropagation;
+
+  while (!algorithmData._banStack.empty()) {
+    if (parallel.numThreads > 1 &&
+        algorithmData._banStack.size() >= parallel.minBans) {
+      // Neighbours are at most one row away
+      propagateSupportCountersInStrips(
+          mCommonParams, algorithmData, parallel.numThreads, 1,
+          [&](const BannedPattern &banned, auto functor) {
+            forEachSupported(banned, algorithmData, functor);
+          });
+      return;
+    }
+
+    const BannedPattern banned = algorithmData._banStack.back();
+    algorithmData._banStack.pop_back();
+
+    forEachSupported(banned, algorithmData,
+                     [&](const Index2D &index2, SupportCount &count,
+                         PatternIndex t2) {
+                       // Counts of already banned tiles keep being
+                       // decremented, so every decrement can later be undone
+                       // one for one.
+                       if (--count == 0 && algorithmData._wave.get(index2, t2)) {
+                         ban(mCommonParams, algorithmData, index2, t2);
+                       }
+                     });
+  }
+}
+
+void TileModel::unpropagate(AlgorithmData &algorithmData,
+                            const BannedPattern &banned) const {
+  if (mEngine != PropagationEngine::kSupportCounters) {
+    return;
+  }
+  forEachSupported(
+      banned, algorithmData,
+      [](const Index2D &, SupportCount &count, PatternIndex) { ++count; });
+}
+
+void TileModel::propagateRescan(AlgorithmData &algorithmData) const {
+  // Removes the tiles next to a changed cell which no longer have a
+  // compatible tile in it.
+  auto reviseFcn = [&](const Index2D &index1) {
+    for (size_t d = 0; d < 4; ++d) {
+      Index2D index2;
+      if (!neighbor(index1, d, index2)) {
+        continue;
+      }
+
+      const WaveWord *words1 = algorithmData._wave.cell(index1);
+      const size_t numWords = algorithmData._wave.wordsPerCell();
+
+      algorithmData._wave.forEachPattern(index2, [&](size_t t2) {
+        bool b = false;
+        for (size_t w = 0; w < numWords && !b; ++w) {
+          WaveWord word = words1[w];
+          while (word && !b) {
+            size_t t1 = w * kWaveWordBits + lowestBit(word);
+            b = mInternal._propagator[{d, t1, t2}];
+            word &= word - 1;
           }
         }
-      }
+        if (!b) {
+          ban(mCommonParams, algorithmData, index2, t2);
+        }
+      });
     }
-  }
+  };
 
-  return did_change;
+  // Each round revises the cells changed by the previous one
+  while (!algorithmData._banStack.empty()) {
+    for (const Index2D &index : takeChangedCells(algorithmData)) {
+      reviseFcn(index);
+    }
+  }
 }
 
 std::unique_ptr<Image>
@@ -98,11 +194,8 @@ TileModel::image(const AlgorithmData &algorithmData) const {
   for (size_t x = 0; x < dimension.width; ++x) {
     for (size_t y = 0; y < dimension.height; ++y) {
       double sum = 0;
-      for (size_t t = 0; t < mCommonParams.numPatterns; ++t) {
-        if (algorithmData._wave[{x, y, t}]) {
-          sum += mCommonParams.patternWeights[t];
-        }
-      }
+      algorithmData._wave.forEachPattern(
+          {x, y}, [&](size_t t) { sum += mCommonParams.patternWeights[t]; });
 
       for (size_t yt = 0; yt < mInternal._tile_size; ++yt) {
         for (size_t xt = 0; xt < mInternal._tile_size; ++xt) {
@@ -111,15 +204,13 @@ TileModel::image(const AlgorithmData &algorithmData) const {
                        y * mInternal._tile_size + yt}] = RGBA{0, 0, 0, 255};
           } else {
             double r = 0, g = 0, b = 0, a = 0;
-            for (size_t t = 0; t < mCommonParams.numPatterns; ++t) {
-              if (algorithmData._wave[{x, y, t}]) {
-                RGBA c = mInternal._tiles[t][xt + yt * mInternal._tile_size];
-                r += (double)c.r * mCommonParams.patternWeights[t] / sum;
-                g += (double)c.g * mCommonParams.patternWeights[t] / sum;
-                b += (double)c.b * mCommonParams.patternWeights[t] / sum;
-                a += (double)c.a * mCommonParams.patternWeights[t] / sum;
-              }
-            }
+            algorithmData._wave.forEachPattern({x, y}, [&](size_t t) {
+              RGBA c = mInternal._tiles[t][xt + yt * mInternal._tile_size];
+              r += (double)c.r * mCommonParams.patternWeights[t] / sum;
+              g += (double)c.g * mCommonParams.patternWeights[t] / sum;
+              b += (double)c.b * mCommonParams.patternWeights[t] / sum;
+              a += (double)c.a * mCommonParams.patternWeights[t] / sum;
+            });
 
             (*result)[{x * mInternal._tile_size + xt,
                        y * mInternal._tile_size + yt}] =
@@ -206,8 +297,37 @@ MapFunctions mapFunctions(Symmetry symmetry) {
 }
 
 AlgorithmData TileModel::initAlgorithmData() const {
-  return initialOutput(mCommonParams.mOutputProperties.dimensions,
-                       mCommonParams.numPatterns);
+  return *mInitialData;
+}
+
+AlgorithmData TileModel::buildInitialData() const {
+  AlgorithmData toReturn = initialOutput(mCommonParams);
+
+  if (mEngine == PropagationEngine::kSupportCounters) {
+    initSupportCounts(toReturn);
+  }
+
+  // A tile which allows nothing in some direction can't go anywhere that
+  // direction has a neighbour. Neither engine would notice before that
+  // neighbour changes, so remove it up front.
+  const size_t numPatterns = mCommonParams.numPatterns;
+  for (size_t d = 0; d < 4; ++d) {
+    for (size_t t1 = 0; t1 < numPatterns; ++t1) {
+      if (!mInternal._compatible[{d, t1}].empty()) {
+        continue;
+      }
+      range2D(mCommonParams.mOutputProperties.dimensions)(
+          [&](const Index2D &index) {
+            Index2D index2;
+            if (neighbor(index, d, index2) && toReturn._wave.get(index, t1)) {
+              ban(mCommonParams, toReturn, index, t1);
+            }
+          });
+    }
+  }
+
+  propagate(toReturn);
+  return toReturn;
 }
 
 SymmetryInfo convert(Symmetry symmetry) {
@@ -240,12 +360,15 @@ rotateConvert(const std::vector<CopiedTile> &copiedTiles, size_t tileSize) {
 // algorithm-specific files. This file is just meant for loading config with
 // configuru.
 TileModelInternal fromConfig(const TileModelConfig &config) {
+  Stopwatch stopwatch;
   TileModelInternal toReturn;
 
   toReturn.mCommonParams.mOutputProperties = config.commonParam;
 
   toReturn._tile_size = config.tileSize;
 
+  toReturn.parallelPropagation.numThreads = config.propagationThreads;
+
   const bool unique = config.unique;
 
   const std::unordered_set<std::string> &subset = config.subset;
@@ -306,7 +429,11 @@ TileModelInternal fromConfig(const TileModelConfig &config) {
   }
 
   toReturn.mCommonParams.numPatterns = action.size();
+  toReturn.mCommonParams.patternWeightLogWeights =
+      calculateWeightLogWeights(toReturn.mCommonParams.patternWeights);
+  toReturn.buildStatistics.extractionSeconds = stopwatch.seconds();
 
+  stopwatch.restart();
   toReturn._propagator = Array3D<Bool>({4, toReturn.mCommonParams.numPatterns,
                                         toReturn.mCommonParams.numPatterns},
                                        false);
@@ -343,5 +470,18 @@ TileModelInternal fromConfig(const TileModelConfig &config) {
       toReturn._propagator[{3, t1, t2}] = toReturn._propagator[{1, t2, t1}];
     }
   }
+
+  toReturn._compatible = Array2D<std::vector<PatternIndex>>(
+      {4, toReturn.mCommonParams.numPatterns});
+  for (size_t d = 0; d < 4; ++d) {
+    for (size_t t1 = 0; t1 < toReturn.mCommonParams.numPatterns; ++t1) {
+      for (size_t t2 = 0; t2 < toReturn.mCommonParams.numPatterns; ++t2) {
+        if (toReturn._propagator[{d, t1, t2}]) {
+          toReturn._compatible[{d, t1}].push_back(t2);
+        }
+      }
+    }
+  }
+  toReturn.buildStatistics.propagatorSeconds = stopwatch.seconds();
   return toReturn;
 }
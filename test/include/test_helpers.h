@@ -0,0 +1,42 @@
+#pragma once
+
+#include <wfc/algorithm.h>
+#include <wfc/imodel.h>
+#include <wfc/overlapping_model.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Helpers shared by the unit tests.
+
+// Makes a black/white checkerboard pattern of the desired size where the bottom
+// left corner is black.
+PalettedImage checkerBoard(size_t width);
+
+// With n = 2 a 4 x 4 checkerboard has two patterns, each of which forces the
+// other next to it. An odd periodic output therefore can't be tiled, and a run
+// on an even one makes a single observation.
+OverlappingComputedInfo checkerboardInfo(const Dimension2D &outputSize);
+
+// A small two-colour image with some structure: horizontal and vertical
+// stripes with a few flipped pixels.
+PalettedImage stripedSample();
+
+using ModelFactory =
+    std::function<std::shared_ptr<const Model>(PropagationEngine)>;
+
+// Makes one model per engine.
+std::vector<std::shared_ptr<const Model>>
+makeModels(const ModelFactory &factory,
+           const std::vector<PropagationEngine> &engines);
+
+// Checks more than the wave on the data of all models, before every step.
+using StepCheck =
+    std::function<void(const std::vector<AlgorithmData> &, int step)>;
+
+// Makes the same observations on all models, choosing them on the first, and
+// checks that propagation leaves the same wave before every step.
+void expectSameWaves(const CommonParams &commonParams,
+                     const std::vector<std::shared_ptr<const Model>> &models,
+                     unsigned seed, const StepCheck &check = {});
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <wfc/algorithm.h>
+
+#include <cmath>
+
+CommonParams testParams(const Dimension2D &dimension,
+                        const std::vector<double> &weights) {
+  CommonParams toReturn;
+  toReturn.mOutputProperties = {dimension, true};
+  toReturn.numPatterns = weights.size();
+  toReturn.patternWeights = weights;
+  toReturn.patternWeightLogWeights = calculateWeightLogWeights(weights);
+  return toReturn;
+}
+
+void expectEntropyEqual(const CellEntropy &left, const CellEntropy &right) {
+  EXPECT_EQ(left.numPossible, right.numPossible);
+  EXPECT_NEAR(left.sumOfWeights, right.sumOfWeights, 1e-9);
+  EXPECT_NEAR(left.sumOfWeightLogWeights, right.sumOfWeightLogWeights, 1e-9);
+  EXPECT_NEAR(left.entropy, right.entropy, 1e-9);
+}
+
+TEST(EntropyTest, banKeepsSumsInSync) {
+  std::vector<double> weights = {1, 2, 3, 4, 5, 6, 7};
+  CommonParams commonParams = testParams({4, 3}, weights);
+  AlgorithmData algorithmData = initialOutput(commonParams);
+
+  Index2D index{2, 1};
+  for (size_t t : {3, 0, 6, 0, 5, 1}) {
+    ban(commonParams, algorithmData, index, t);
+    expectEntropyEqual(algorithmData._entropies[index],
+                       calculateEntropy(algorithmData._wave, index,
+                                        commonParams));
+  }
+
+  ASSERT_EQ(algorithmData._entropies[index].numPossible, 2u);
+  // Untouched cells keep the full distribution
+  Index2D untouched{0, 0};
+  expectEntropyEqual(algorithmData._entropies[untouched],
+                     calculateEntropy(algorithmData._wave, untouched,
+                                      commonParams));
+}
+
+TEST(EntropyTest, shannonEntropy) {
+  CommonParams commonParams = testParams({1, 1}, {1, 1, 1, 1});
+  AlgorithmData algorithmData = initialOutput(commonParams);
+
+  Index2D index{0, 0};
+
+  // Uniform over 4 patterns
+  EXPECT_NEAR(algorithmData._entropies[index].entropy, std::log(4.0), 1e-12);
+
+  ban(commonParams, algorithmData, index, 0);
+  ban(commonParams, algorithmData, index, 1);
+  EXPECT_NEAR(algorithmData._entropies[index].entropy, std::log(2.0), 1e-12);
+
+  ban(commonParams, algorithmData, index, 2);
+  EXPECT_EQ(algorithmData._entropies[index].entropy, 0);
+}
+
+TEST(EntropyHeapTest, popsLowestFirstWithScanOrderTies) {
+  EntropyHeap heap;
+  heap.push(2.0, {0, 0});
+  heap.push(1.0, {3, 1});
+  heap.push(1.0, {1, 2});
+  heap.push(1.0, {2, 1});
+
+  std::vector<Index2D> order;
+  while (!heap.empty()) {
+    order.push_back(heap.top().index);
+    heap.pop();
+  }
+
+  std::vector<Index2D> expected = {{2, 1}, {3, 1}, {1, 2}, {0, 0}};
+  ASSERT_EQ(order.size(), expected.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    EXPECT_EQ(order[i], expected[i]);
+  }
+}
+
+TEST(AlgorithmDataPoolTest, reusesAndResets) {
+  std::vector<double> weights = {1, 2, 3};
+  CommonParams commonParams = testParams({5, 4}, weights);
+  AlgorithmDataPool pool(initialOutput(commonParams));
+
+  Index2D index{1, 2};
+  {
+    AlgorithmDataPool::Handle algorithmData = pool.acquire();
+    ban(commonParams, *algorithmData, index, 0);
+    ban(commonParams, *algorithmData, index, 1);
+    ban(commonParams, *algorithmData, index, 2);
+    EXPECT_TRUE(algorithmData->_contradiction);
+  }
+
+  AlgorithmDataPool::Handle first = pool.acquire();
+  EXPECT_EQ(pool.numAllocated(), 1u);
+  EXPECT_TRUE(first->_wave == pool.pristine()._wave);
+  EXPECT_EQ(first->_entropies[index].numPossible, 3u);
+  EXPECT_FALSE(first->_contradiction);
+  EXPECT_TRUE(first->_banStack.empty());
+
+  // Handles held at the same time get separate data
+  AlgorithmDataPool::Handle second = pool.acquire();
+  EXPECT_EQ(pool.numAllocated(), 2u);
+  EXPECT_NE(first.get(), second.get());
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <wfc/algorithm.h>
+#include <wfc/backtracking.h>
+#include <wfc/overlapping_model.h>
+#include <wfc/ranges.h>
+
+#include "test_helpers.h"
+
+#include <random>
+
+TEST(BacktrackingTest, backtrackUndoesAndBans) {
+  OverlappingComputedInfo info = checkerboardInfo({6, 6});
+  OverlappingModel model(info);
+  const CommonParams &commonParams = info.commonParams;
+  ASSERT_EQ(commonParams.numPatterns, 2u);
+
+  AlgorithmData algorithmData = model.initAlgorithmData();
+  AlgorithmData expected = algorithmData;
+
+  Index2D index{2, 3};
+  Backtracker backtracker(4);
+  backtracker.record(algorithmData, index, 0);
+  updateSelectedPattern(commonParams, algorithmData, index, 0);
+  model.propagate(algorithmData);
+  EXPECT_EQ(algorithmData._wave.count({0, 0}), 1u);
+
+  ASSERT_TRUE(backtracker.backtrack(commonParams, model, algorithmData));
+  EXPECT_EQ(backtracker.backtracks(), 1u);
+  EXPECT_EQ(backtracker.depth(), 0u);
+
+  // Same as having banned the pattern in the first place
+  ban(commonParams, expected, index, 0);
+  model.propagate(expected);
+  EXPECT_TRUE(algorithmData._wave == expected._wave);
+  EXPECT_FALSE(algorithmData._wave.get(index, 0));
+  EXPECT_FALSE(algorithmData._contradiction);
+
+  EXPECT_FALSE(backtracker.backtrack(commonParams, model, algorithmData));
+}
+
+TEST(BacktrackingTest, depthIsBounded) {
+  OverlappingComputedInfo info = checkerboardInfo({6, 6});
+  OverlappingModel model(info);
+  AlgorithmData algorithmData = model.initAlgorithmData();
+
+  Backtracker backtracker(2);
+  for (size_t x = 0; x < 3; ++x) {
+    backtracker.record(algorithmData, {x, 0}, 0);
+  }
+  EXPECT_EQ(backtracker.depth(), 2u);
+
+  Backtracker disabled(0);
+  disabled.record(algorithmData, {0, 0}, 0);
+  EXPECT_EQ(disabled.depth(), 0u);
+}
+
+TEST(BacktrackingTest, runGivesUpWhenEverythingFails) {
+  OverlappingComputedInfo info = checkerboardInfo({5, 5});
+  OverlappingModel model(info);
+  AlgorithmData algorithmData = model.initAlgorithmData();
+
+  RunStatistics statistics;
+  Result result =
+      run(info.commonParams, algorithmData, model, 0, 0, 8, &statistics);
+
+  // Both patterns are tried at the first cell observed
+  EXPECT_EQ(result, Result::kFail);
+  EXPECT_EQ(statistics.result, Result::kFail);
+  EXPECT_EQ(statistics.backtracks, 1u);
+  EXPECT_EQ(statistics.observations, 1u);
+  EXPECT_EQ(statistics.contradictions, 2u);
+}
+
+void expectSameState(const AlgorithmData &left, const AlgorithmData &right) {
+  EXPECT_TRUE(left._wave == right._wave);
+  EXPECT_TRUE(left._supportCounts == right._supportCounts);
+  EXPECT_EQ(left._contradiction, right._contradiction);
+  runForDimension(left._wave.size(), [&](const Index2D &index) {
+    EXPECT_EQ(left._entropies[index].numPossible,
+              right._entropies[index].numPossible);
+    EXPECT_EQ(left._entropies[index].entropy, right._entropies[index].entropy);
+  });
+}
+
+// Observes and propagates at a few levels, then undoes them one by one and
+// checks each undo gets back exactly the state its level started from.
+void expectUndoRestores(PropagationEngine engine) {
+  OverlappingComputedInfo info =
+      fromConfig({stripedSample(), true, 8, false, 3, {{12, 10}, true}});
+  OverlappingModel model(info, engine);
+  const CommonParams &commonParams = info.commonParams;
+
+  AlgorithmData algorithmData = model.initAlgorithmData();
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> dis(0.0, 1.0);
+  RandomDouble randomDouble = [&]() { return dis(gen); };
+
+  std::vector<AlgorithmData> levels;
+  for (int level = 0; level < 4 && !algorithmData._contradiction; ++level) {
+    levels.push_back(algorithmData);
+    pushTrailLevel(algorithmData);
+    observe(commonParams, model, algorithmData, randomDouble);
+    model.propagate(algorithmData);
+  }
+  ASSERT_GE(levels.size(), 2u);
+
+  while (!levels.empty()) {
+    undoTrailLevel(model, algorithmData);
+    expectSameState(algorithmData, levels.back());
+    levels.pop_back();
+  }
+  EXPECT_TRUE(algorithmData._trail.empty());
+}
+
+TEST(TrailTest, undoRestoresRescan) {
+  expectUndoRestores(PropagationEngine::kRescan);
+}
+
+TEST(TrailTest, undoRestoresSupportCounters) {
+  expectUndoRestores(PropagationEngine::kSupportCounters);
+}
+
+TEST(TrailTest, nothingRecordedWithoutLevels) {
+  OverlappingComputedInfo info = checkerboardInfo({6, 6});
+  OverlappingModel model(info);
+  AlgorithmData algorithmData = model.initAlgorithmData();
+
+  ban(info.commonParams, algorithmData, {1, 1}, 0);
+  model.propagate(algorithmData);
+  EXPECT_TRUE(algorithmData._trail.empty());
+
+  pushTrailLevel(algorithmData);
+  pushTrailLevel(algorithmData);
+  ban(info.commonParams, algorithmData, {1, 1}, 1);
+  size_t recorded = algorithmData._trail.size();
+  EXPECT_EQ(recorded, 1u);
+
+  // Dropping the oldest level keeps what the newer one recorded
+  dropOldestTrailLevel(algorithmData);
+  EXPECT_EQ(algorithmData._trailLevels.size(), 1u);
+  EXPECT_EQ(algorithmData._trail.size(), recorded);
+}
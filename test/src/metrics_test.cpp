@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+
+#include <wfc/algorithm.h>
+#include <wfc/metrics.h>
+#include <wfc/overlapping_model.h>
+
+#include <configuru.hpp>
+
+#include "test_helpers.h"
+
+TEST(RunStatisticsTest, countsAndAggregates) {
+  OverlappingComputedInfo info = checkerboardInfo({6, 6});
+  OverlappingModel model(info);
+  AlgorithmDataPool pool(model.initialData());
+
+  // The first observation decides every cell: the one observed loses a
+  // pattern to it, every other one to propagation
+  RunStatistics first;
+  ASSERT_TRUE(createImage(info.commonParams, model, pool, 0, 0, 0, &first));
+  EXPECT_EQ(first.result, Result::kSuccess);
+  EXPECT_EQ(first.observations, 1u);
+  EXPECT_EQ(first.propagations, 1u);
+  EXPECT_EQ(first.bans, 36u);
+  EXPECT_EQ(first.contradictions, 0u);
+  EXPECT_GE(first.peakStateBytes, pool.pristine()._wave.bytes());
+
+  RunStatistics second;
+  second.result = Result::kFail;
+  second.bans = 4;
+  second.peakStateBytes = first.peakStateBytes + 1;
+
+  RunStatistics total = aggregate({first, second});
+  EXPECT_EQ(total.result, Result::kFail);
+  EXPECT_EQ(total.bans, 40u);
+  EXPECT_EQ(total.peakStateBytes, first.peakStateBytes + 1);
+}
+
+TEST(MetricsTest, json) {
+  RunStatistics success;
+  success.result = Result::kSuccess;
+  RunStatistics failure;
+  failure.result = Result::kFail;
+
+  SampleMetrics sample;
+  sample.name = "checkerboard";
+  sample.runs = {success, failure};
+  configuru::Config json =
+      configuru::parse_string(metricsToJson({sample}).c_str(), configuru::JSON,
+                              "metrics");
+  EXPECT_EQ(json[0]["name"].as_string(), "checkerboard");
+  EXPECT_EQ(json[0]["total"]["successes"].get<int>(), 1);
+  EXPECT_EQ(json[0]["runs"][1]["result"].as_string(), "fail");
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <wfc/model_cache.h>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+// Gives every test a directory of its own under the system's temporary one,
+// which is removed with everything in it once the test is over.
+class ModelCacheTest : public ::testing::Test {
+
+protected:
+  void SetUp() override {
+    std::random_device random;
+    mCacheDir = std::filesystem::temp_directory_path() /
+                ("wfc_model_cache_test_" + std::to_string(random()));
+  }
+
+  void TearDown() override { std::filesystem::remove_all(mCacheDir); }
+
+  std::string cacheDir() const { return mCacheDir.string(); }
+
+private:
+  std::filesystem::path mCacheDir;
+};
+
+// Three colours with a floor row, so the model has a foundation.
+OverlappingModelConfig cacheTestConfig() {
+  Dimension2D dimension{7, 6};
+  Array2D<ColorIndex> data(dimension);
+  for (size_t y = 0; y < dimension.height; ++y) {
+    for (size_t x = 0; x < dimension.width; ++x) {
+      data[{x, y}] = (y == dimension.height - 1) ? 2 : ((x * x + y) % 3 == 0);
+    }
+  }
+  PalettedImage sample{
+      data, {{255, 255, 255, 255}, {0, 0, 0, 255}, {90, 60, 30, 255}}};
+  return {sample, false, 2, true, 3, {{16, 12}, false}};
+}
+
+void expectSameModel(const OverlappingComputedInfo &left,
+                     const OverlappingComputedInfo &right) {
+  EXPECT_EQ(left.internal._n, right.internal._n);
+  EXPECT_EQ(left.internal.foundation, right.internal.foundation);
+  EXPECT_TRUE(left.internal._palette == right.internal._palette);
+  EXPECT_TRUE(left.internal._patterns == right.internal._patterns);
+  EXPECT_TRUE(left.internal._propagator == right.internal._propagator);
+  EXPECT_EQ(left.commonParams.numPatterns, right.commonParams.numPatterns);
+  EXPECT_EQ(left.commonParams.patternWeights,
+            right.commonParams.patternWeights);
+  EXPECT_EQ(left.commonParams.patternWeightLogWeights,
+            right.commonParams.patternWeightLogWeights);
+}
+
+TEST_F(ModelCacheTest, warmStartMatchesCompiledModel) {
+  OverlappingModelConfig config = cacheTestConfig();
+  OverlappingComputedInfo compiled = fromConfig(config);
+
+  config.cache_dir = cacheDir();
+  uint64_t key = modelCacheKey(config);
+  std::string path = modelCachePath(cacheDir(), key);
+
+  OverlappingComputedInfo cold = fromConfig(config);
+  expectSameModel(compiled, cold);
+
+  OverlappingComputedInfo loaded;
+  ASSERT_TRUE(loadCachedModel(path, key, loaded));
+
+  OverlappingComputedInfo warm = fromConfig(config);
+  expectSameModel(compiled, warm);
+  EXPECT_EQ(warm.commonParams.mOutputProperties.dimensions,
+            config.outputProperties.dimensions);
+}
+
+TEST_F(ModelCacheTest, propagatorIsReadInPlace) {
+  // An odd number of patterns of side 3, so their cells take an odd number
+  // of bytes
+  OverlappingModelConfig config = cacheTestConfig();
+  config.sample_image.data[{0, 0}] = 2;
+  config.symmetry = 1;
+  OverlappingComputedInfo compiled = fromConfig(config);
+  ASSERT_EQ(compiled.internal._patterns.size() % 2, 1u);
+
+  uint64_t key = modelCacheKey(config);
+  std::string path = modelCachePath(cacheDir(), key);
+  ASSERT_TRUE(saveCachedModel(path, key, compiled));
+
+  OverlappingComputedInfo loaded;
+  ASSERT_TRUE(loadCachedModel(path, key, loaded));
+  const Propagator &propagator = loaded.internal._propagator;
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(propagator.offsets().begin()) %
+                alignof(uint64_t),
+            0u);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(propagator.entries().begin()) %
+                alignof(PatternIndex),
+            0u);
+
+  // The model keeps the file mapped, and copies share the mapping
+  const PatternIndex *entries = propagator.entries().begin();
+  std::filesystem::remove(path);
+  OverlappingModelInternal copy = loaded.internal;
+  loaded = OverlappingComputedInfo();
+  EXPECT_EQ(copy._propagator.entries().begin(), entries);
+  EXPECT_TRUE(copy._propagator == compiled.internal._propagator);
+}
+
+TEST_F(ModelCacheTest, otherFilesAreNotLoaded) {
+  OverlappingModelConfig config = cacheTestConfig();
+  uint64_t key = modelCacheKey(config);
+
+  // Any setting that changes the model changes the key
+  OverlappingModelConfig other = config;
+  other.symmetry = 8;
+  EXPECT_NE(modelCacheKey(other), key);
+  other = config;
+  other.sample_image.data[{0, 0}] = 2;
+  EXPECT_NE(modelCacheKey(other), key);
+
+  std::string path = modelCachePath(cacheDir(), key);
+  ASSERT_TRUE(saveCachedModel(path, key, fromConfig(config)));
+
+  OverlappingComputedInfo info;
+  EXPECT_FALSE(loadCachedModel(path, key + 1, info));
+  EXPECT_TRUE(info.internal._patterns.empty());
+
+  // Cut short
+  std::string truncatedPath = path + ".truncated";
+  {
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)),
+                      std::istreambuf_iterator<char>());
+    std::ofstream out(truncatedPath, std::ios::binary);
+    out.write(bytes.data(), bytes.size() - 1);
+  }
+  EXPECT_FALSE(loadCachedModel(truncatedPath, key, info));
+  EXPECT_TRUE(loadCachedModel(path, key, info));
+}
@@ -0,0 +1,230 @@
+#include <gtest/gtest.h>
+
+#include <wfc/algorithm.h>
+#include <wfc/configuru.h>
+#include <wfc/overlapping_model.h>
+#include <wfc/ranges.h>
+
+#include "test_helpers.h"
+
+#include <cstdlib>
+
+OverlappingComputedInfo testInfo(bool periodicIn, bool periodicOut) {
+  OverlappingModelConfig config{stripedSample(), periodicIn, 8,    false, 3,
+                                {{12, 10}, periodicOut}};
+  return fromConfig(config);
+}
+
+// Makes the same observations with every engine and compatibility check and
+// checks that propagation leaves the same wave after every step.
+void expectSameWaves(const OverlappingComputedInfo &info, unsigned seed) {
+  auto factoryFcn = [&](PropagationEngine engine) {
+    return std::make_shared<OverlappingModel>(info, engine,
+                                              CompatibilityCheck::kLists);
+  };
+  auto models = makeModels(
+      factoryFcn,
+      {PropagationEngine::kRescan, PropagationEngine::kSupportCounters});
+  models.push_back(std::make_shared<OverlappingModel>(
+      info, PropagationEngine::kRescan, CompatibilityCheck::kMasks));
+  expectSameWaves(info.commonParams, models, seed);
+}
+
+TEST(OverlappingPropagationTest, enginesAgreePeriodic) {
+  OverlappingComputedInfo info = testInfo(true, true);
+  for (unsigned seed = 0; seed < 3; ++seed) {
+    expectSameWaves(info, seed);
+  }
+}
+
+TEST(OverlappingPropagationTest, enginesAgreeNonPeriodic) {
+  OverlappingComputedInfo info = testInfo(false, false);
+  for (unsigned seed = 0; seed < 3; ++seed) {
+    expectSameWaves(info, seed);
+  }
+}
+
+TEST(PropagationEngineTest, countersOnlyWhileTheirCopiesAreSmall) {
+  // 48 X 48 cells, 25 overlap offsets as with patterns of side 3
+  CommonParams commonParams{{{48, 48}, false}, 100, {}, {}};
+  EXPECT_EQ(supportCounterBytes(commonParams, 25), size_t(48 * 48 * 100 * 50));
+  EXPECT_EQ(choosePropagationEngine(commonParams, 25),
+            PropagationEngine::kSupportCounters);
+
+  commonParams.numPatterns = 1000;
+  EXPECT_EQ(choosePropagationEngine(commonParams, 25),
+            PropagationEngine::kRescan);
+
+  // One copy would fit, but not the pooled one as well
+  commonParams.numPatterns =
+      kMaxSupportCounterBytes / (48 * 48 * sizeof(SupportCount));
+  EXPECT_LE(supportCounterBytes(commonParams, 1), kMaxSupportCounterBytes);
+  EXPECT_EQ(choosePropagationEngine(commonParams, 1),
+            PropagationEngine::kRescan);
+}
+
+TEST(OverlappingConfigTest, patternSideIsChecked) {
+  configuru::Config config =
+      configuru::parse_string("{image: \"missing.bmp\", n: 9}",
+                              configuru::CFG, "config");
+  EXPECT_THROW(extractOverlappingConfig("", config), std::runtime_error);
+  config["n"] = 0;
+  EXPECT_THROW(extractOverlappingConfig("", config), std::runtime_error);
+
+  OverlappingModelConfig modelConfig{stripedSample(), true, 8, false, 9,
+                                     {{12, 10}, true}};
+  EXPECT_DEATH(fromConfig(modelConfig), "n = 9");
+}
+
+TEST(OverlappingModelTest, initialDataIsWorkedOutOnce) {
+  OverlappingComputedInfo info = testInfo(false, false);
+  OverlappingModel model(info);
+  OverlappingModel copy = model;
+  EXPECT_EQ(model.initialData(), copy.initialData());
+
+  AlgorithmData algorithmData = copy.initAlgorithmData();
+  EXPECT_TRUE(algorithmData._wave == model.initialData()->_wave);
+  EXPECT_TRUE(algorithmData._supportCounts ==
+              model.initialData()->_supportCounts);
+}
+
+TEST(PropagatorTest, listsMatchAgrees) {
+  OverlappingComputedInfo info = testInfo(false, false);
+  const OverlappingModelInternal &internal = info.internal;
+  const Propagator &propagator = internal._propagator;
+  const int n = internal._n;
+
+  Dimension3D size = propagator.size();
+  size_t numEntries = 0;
+  for (size_t t = 0; t < size.width; ++t) {
+    for (size_t x = 0; x < size.height; ++x) {
+      for (size_t y = 0; y < size.depth; ++y) {
+        std::vector<PatternIndex> expected;
+        for (size_t t2 = 0; t2 < size.width; ++t2) {
+          if (agrees(internal._patterns[t], internal._patterns[t2], x - n + 1,
+                     y - n + 1, n)) {
+            expected.push_back(t2);
+          }
+        }
+        Span<const PatternIndex> list = propagator[{t, x, y}];
+        ASSERT_EQ(std::vector<PatternIndex>(list.begin(), list.end()),
+                  expected);
+        numEntries += list.size();
+      }
+    }
+  }
+  EXPECT_EQ(propagator.numEntries(), numEntries);
+}
+
+TEST(PropagatorTest, sameForAnyBuilderAndNumberOfThreads) {
+  OverlappingComputedInfo info = testInfo(true, true);
+  const OverlappingModelInternal &internal = info.internal;
+  size_t numPatterns = internal._patterns.size();
+
+  Propagator serial =
+      createPropagator(numPatterns, internal._n, internal._patterns, 1);
+  Propagator parallel =
+      createPropagator(numPatterns, internal._n, internal._patterns, 4);
+  EXPECT_TRUE(serial == parallel);
+  EXPECT_TRUE(serial == internal._propagator);
+
+  Propagator pairwise = createPropagatorPairwise(numPatterns, internal._n,
+                                                 internal._patterns, 4);
+  EXPECT_TRUE(serial == pairwise);
+}
+
+// Every two cells whose patterns overlap in the output have to agree on the
+// pixels they share, whichever neighbourhood propagation went through.
+void expectOverlapsAgree(const OverlappingComputedInfo &info,
+                         const OverlappingModel &model,
+                         const AlgorithmData &algorithmData) {
+  const OverlappingModelInternal &internal = info.internal;
+  const Wave &wave = algorithmData._wave;
+  Dimension2D dimension = wave.size();
+
+  auto patternFcn = [&](const Index2D &index) {
+    size_t toReturn = 0;
+    wave.forEachPattern(index, [&](size_t t) { toReturn = t; });
+    return toReturn;
+  };
+
+  std::vector<Offset2D> window =
+      neighbourhoodOffsets(internal._n, OverlapNeighbourhood::kWindow);
+  runForDimension(dimension, [&](const Index2D &index) {
+    if (model.on_boundary(index)) {
+      return;
+    }
+    ASSERT_EQ(wave.count(index), 1u) << index;
+    for (const Offset2D &offset : window) {
+      Index2D sIndex = shiftWrapped(index, offset, dimension);
+      if (model.on_boundary(sIndex)) {
+        continue;
+      }
+      EXPECT_TRUE(agrees(internal._patterns[patternFcn(index)],
+                         internal._patterns[patternFcn(sIndex)], offset.x,
+                         offset.y, internal._n))
+          << index << " at " << offset.x << ", " << offset.y;
+    }
+  });
+}
+
+TEST(CardinalNeighbourhoodTest, offsets) {
+  EXPECT_EQ(neighbourhoodOffsets(3, OverlapNeighbourhood::kWindow).size(), 25u);
+  EXPECT_EQ(neighbourhoodOffsets(4, OverlapNeighbourhood::kWindow).size(), 49u);
+
+  std::vector<Offset2D> cardinal =
+      neighbourhoodOffsets(3, OverlapNeighbourhood::kCardinal);
+  ASSERT_EQ(cardinal.size(), 4u);
+  for (const Offset2D &offset : cardinal) {
+    EXPECT_EQ(std::abs(offset.x) + std::abs(offset.y), 1);
+  }
+}
+
+TEST(CardinalNeighbourhoodTest, enginesAgree) {
+  for (bool periodic : {true, false}) {
+    OverlappingComputedInfo info = testInfo(periodic, periodic);
+    info.neighbourhood = OverlapNeighbourhood::kCardinal;
+    for (unsigned seed = 0; seed < 3; ++seed) {
+      expectSameWaves(info, seed);
+    }
+  }
+}
+
+TEST(CardinalNeighbourhoodTest, outputsSatisfyEveryOverlap) {
+  for (OverlapNeighbourhood neighbourhood :
+       {OverlapNeighbourhood::kWindow, OverlapNeighbourhood::kCardinal}) {
+    for (bool periodic : {true, false}) {
+      OverlappingComputedInfo info = testInfo(periodic, periodic);
+      info.neighbourhood = neighbourhood;
+      for (PropagationEngine engine :
+           {PropagationEngine::kRescan, PropagationEngine::kSupportCounters}) {
+        OverlappingModel model(info, engine);
+        size_t numSuccess = 0;
+        for (size_t seed = 0; seed < 4; ++seed) {
+          AlgorithmData algorithmData = model.initAlgorithmData();
+          if (run(info.commonParams, algorithmData, model, seed, 0, 8) ==
+              Result::kSuccess) {
+            expectOverlapsAgree(info, model, algorithmData);
+            ++numSuccess;
+          }
+        }
+        EXPECT_GT(numSuccess, 0u);
+      }
+    }
+  }
+}
+
+// 2, 3 and 4 go through the specialised kernels, 5 through the generic ones.
+TEST(PropagatorTest, sameForEveryPatternSize) {
+  for (int n = 2; n <= 5; ++n) {
+    OverlappingComputedInfo info =
+        fromConfig({stripedSample(), true, 1, false, n, {{12, 10}, true}});
+    const OverlappingModelInternal &internal = info.internal;
+    size_t numPatterns = internal._patterns.size();
+
+    Propagator pairwise = createPropagatorPairwise(numPatterns, n,
+                                                   internal._patterns, 1);
+    EXPECT_TRUE(internal._propagator == pairwise) << "n = " << n;
+    EXPECT_TRUE(agrees(internal._patterns[0], internal._patterns[0], 0, 0, n));
+  }
+}
@@ -6,6 +6,10 @@
 #include <wfc/overlapping_types.h>
 #include <wfc/pattern_properties_comparison.h>
 
+#include "test_helpers.h"
+
+#include <algorithm>
+
 // ========================================================
 
 struct TransformOccurrence {
@@ -26,27 +30,6 @@ Array2D<int> convert(std::initializer_list<TransformOccurrence> toConvert) {
 
 // ========================================================
 
-constexpr RGBA white = {255, 255, 255};
-constexpr RGBA black = {0, 0, 0};
-
-// Makes a black/white checkerboard pattern of the desired size where the bottom
-// left corner is black.
-PalettedImage checkerBoard(size_t width) {
-  Dimension2D dimension{width, width};
-
-  Array2D<ColorIndex> grid(dimension);
-
-  auto functor = [&](const Index2D &index) {
-    bool gridVal = ((index.x + index.y) % 2);
-    grid[index] = gridVal ? 1 : 0;
-    return false;
-  };
-
-  runForDimension(dimension, functor);
-
-  return {grid, {white, black}};
-}
-
 ImagePatternProperties expectedEvenCheckerboardProperties(int sizeFactor) {
   const size_t size = sizeFactor * 2;
 
@@ -248,3 +231,146 @@ TEST(TransformTest, test1) {
 
   runForDimension({4, 2}, consumerFcn);
 }
+
+TEST(PatternTest, sameLayoutAsArray2D) {
+  Array2D<ColorIndex> array{{1, 2, 0}, {0, 3, 0}, {4, 0, 5}};
+  Pattern pattern{{1, 2, 0}, {0, 3, 0}, {4, 0, 5}};
+  ASSERT_EQ(pattern.size(), array.size());
+  EXPECT_TRUE(std::equal(array.data(), array.data() + 9, pattern.data()));
+
+  Pattern filled({3, 3}, 7);
+  filled[{1, 2}] = 0;
+  EXPECT_EQ(filled.data()[2 * 3 + 1], 0);
+  EXPECT_NE(filled, pattern);
+}
+
+// Counts the patterns the slow way: all 8 transforms of every window, each
+// hashed and inserted one at a time.
+PatternPrevalence referencePatterns(const PalettedImage &sample, int n,
+                                    bool periodic_in, size_t symmetry) {
+  Dimension2D dimension = sample.data.size();
+  if (!periodic_in) {
+    dimension = {dimension.width - n + 1, dimension.height - n + 1};
+  }
+
+  PatternPrevalence toReturn;
+  runForDimension(dimension, [&](const Index2D &index) {
+    PatternTransforms ps = generatePatterns(sample, n, index);
+    for (size_t k = 0; k < symmetry; ++k) {
+      const Pattern &pattern = ps[{k / 2, (k % 2) == 1}];
+      toReturn[{pattern, hash_from_pattern(pattern, sample.palette.size())}] +=
+          1;
+    }
+  });
+  return toReturn;
+}
+
+TEST(OverlappingExtractionTest, streamingMatchesAllTransforms) {
+  Dimension2D dimension{9, 7};
+  PalettedImage mixed{Array2D<ColorIndex>(dimension),
+                      Palette(3, RGBA{0, 0, 0, 255})};
+  runForDimension(dimension, [&](const Index2D &index) {
+    mixed.data[index] = (index.x * 7 + index.y * index.y * 3) % 3;
+  });
+
+  // With 256 colours only the last 8 cells of a pattern change its hash, so
+  // from n = 3 on a pattern with the dot in its first cell has the same hash
+  // as the empty one
+  PalettedImage dot{Array2D<ColorIndex>(dimension, 0),
+                    Palette(256, RGBA{0, 0, 0, 255})};
+  dot.data[{4, 3}] = 200;
+
+  // 3 bits a colour: from n = 5 on a cell of the packed key straddles both
+  // of its words
+  PalettedImage sixColors{Array2D<ColorIndex>(dimension),
+                          Palette(6, RGBA{0, 0, 0, 255})};
+  runForDimension(dimension, [&](const Index2D &index) {
+    sixColors.data[index] = (index.x * index.x + index.y * 5) % 6;
+  });
+
+  for (const PalettedImage &sample : {mixed, dot, sixColors}) {
+
+    for (int n : {2, 3, 4, 5}) {
+      for (size_t symmetry : {1, 2, 8}) {
+        for (bool periodic_in : {true, false}) {
+          PatternPrevalence expected =
+              referencePatterns(sample, n, periodic_in, symmetry);
+          PatternPrevalence patterns =
+              extract_patterns(sample, n, periodic_in, symmetry, nullptr);
+
+          // Same patterns and counts, in the same order
+          ASSERT_EQ(patterns.size(), expected.size());
+          auto expectedIt = expected.begin();
+          for (const auto &it : patterns) {
+            EXPECT_TRUE(it.first.pattern == expectedIt->first.pattern);
+            EXPECT_EQ(it.first.hash, expectedIt->first.hash);
+            EXPECT_EQ(it.second, expectedIt->second);
+            ++expectedIt;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(OverlappingExtractionTest, packedKeyLimits) {
+  EXPECT_EQ(bitsPerColor(2), 1u);
+  EXPECT_EQ(bitsPerColor(3), 2u);
+  EXPECT_EQ(bitsPerColor(256), 8u);
+  EXPECT_TRUE(fitsPackedKey(4, 256));
+  EXPECT_FALSE(fitsPackedKey(5, 256));
+  EXPECT_TRUE(fitsPackedKey(5, 32));
+  EXPECT_FALSE(fitsPackedKey(5, 33));
+  EXPECT_TRUE(fitsPackedKey(8, 4));
+}
+
+TEST(OverlappingExtractionTest, bandsMatchSingleThread) {
+  // Large enough for three bands, with a floor row for the lowest pattern
+  Dimension2D dimension{256, 3 * kMinBandPixels / 256};
+  PalettedImage sample{Array2D<ColorIndex>(dimension),
+                       Palette(5, RGBA{0, 0, 0, 255})};
+  runForDimension(dimension, [&](const Index2D &index) {
+    sample.data[index] = index.y == dimension.height - 1
+                             ? 4
+                             : ((index.x * index.x) / 7 + index.y * 3) % 4;
+  });
+
+  for (size_t numThreads : {2, 3}) {
+    for (int n : {2, 3}) {
+      for (size_t symmetry : {1, 8}) {
+        for (bool periodic_in : {true, false}) {
+          Pattern expectedLowest;
+          PatternPrevalence expected = extract_patterns(
+              sample, n, periodic_in, symmetry, &expectedLowest, 1);
+          Pattern lowest;
+          PatternPrevalence patterns = extract_patterns(
+              sample, n, periodic_in, symmetry, &lowest, numThreads);
+
+          EXPECT_TRUE(lowest == expectedLowest);
+          ASSERT_EQ(patterns.size(), expected.size());
+          auto expectedIt = expected.begin();
+          for (const auto &it : patterns) {
+            EXPECT_TRUE(it.first.pattern == expectedIt->first.pattern);
+            EXPECT_EQ(it.second, expectedIt->second);
+            ++expectedIt;
+          }
+        }
+      }
+    }
+  }
+
+  ImagePatternProperties expected = extractPatternsFromImage(sample, 3, 1);
+  ImagePatternProperties properties = extractPatternsFromImage(sample, 3, 3);
+  ASSERT_EQ(properties.patterns.size(), expected.patterns.size());
+  for (size_t t = 0; t < expected.patterns.size(); ++t) {
+    EXPECT_TRUE(properties.patterns[t].pattern == expected.patterns[t].pattern);
+    EXPECT_TRUE(properties.patterns[t].occurrence ==
+                expected.patterns[t].occurrence);
+  }
+  runForDimension(dimension, [&](const Index2D &index) {
+    EXPECT_EQ(properties.grid[index].patternIndex,
+              expected.grid[index].patternIndex);
+    EXPECT_TRUE(properties.grid[index].enumeratedTransform ==
+                expected.grid[index].enumeratedTransform);
+  });
+}
@@ -0,0 +1,93 @@
+#include "test_helpers.h"
+
+#include <gtest/gtest.h>
+
+#include <wfc/ranges.h>
+
+#include <random>
+
+PalettedImage checkerBoard(size_t width) {
+  Dimension2D dimension{width, width};
+
+  Array2D<ColorIndex> grid(dimension);
+
+  auto functor = [&](const Index2D &index) {
+    bool gridVal = ((index.x + index.y) % 2);
+    grid[index] = gridVal ? 1 : 0;
+    return false;
+  };
+
+  runForDimension(dimension, functor);
+
+  return {grid, {{255, 255, 255, 255}, {0, 0, 0, 255}}};
+}
+
+PalettedImage stripedSample() {
+  Dimension2D dimension{8, 8};
+  Array2D<ColorIndex> data(dimension);
+  std::mt19937 gen(7);
+  for (size_t y = 0; y < dimension.height; ++y) {
+    for (size_t x = 0; x < dimension.width; ++x) {
+      bool stripe = (x % 4 == 0) || (y % 3 == 0);
+      bool flip = (gen() % 7) == 0;
+      data[{x, y}] = (stripe != flip) ? 1 : 0;
+    }
+  }
+  return {data, {{255, 255, 255, 255}, {0, 0, 0, 255}}};
+}
+
+OverlappingComputedInfo checkerboardInfo(const Dimension2D &outputSize) {
+  return fromConfig({checkerBoard(4), true, 1, false, 2, {outputSize, true}});
+}
+
+std::vector<std::shared_ptr<const Model>>
+makeModels(const ModelFactory &factory,
+           const std::vector<PropagationEngine> &engines) {
+  std::vector<std::shared_ptr<const Model>> toReturn;
+  for (PropagationEngine engine : engines) {
+    toReturn.push_back(factory(engine));
+  }
+  return toReturn;
+}
+
+void expectSameWaves(const CommonParams &commonParams,
+                     const std::vector<std::shared_ptr<const Model>> &models,
+                     unsigned seed, const StepCheck &check) {
+  ASSERT_FALSE(models.empty());
+  std::vector<AlgorithmData> data;
+  for (const auto &model : models) {
+    data.push_back(model->initAlgorithmData());
+  }
+
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> dis(0.0, 1.0);
+  RandomDouble randomDouble = [&]() { return dis(gen); };
+
+  for (int step = 0; step < 1000; ++step) {
+    for (size_t i = 1; i < models.size(); ++i) {
+      ASSERT_TRUE(data[0]._wave == data[i]._wave)
+          << "model " << i << ", step " << step;
+      ASSERT_EQ(data[0]._contradiction, data[i]._contradiction)
+          << "model " << i << ", step " << step;
+    }
+    if (check) {
+      check(data, step);
+      if (::testing::Test::HasFatalFailure()) {
+        return;
+      }
+    }
+
+    EntropyResult result = find_lowest_entropy(*models[0], data[0]);
+    if (result.code != Result::kUnfinished) {
+      return;
+    }
+
+    size_t pattern = selectPattern(
+        result.minIndex, commonParams.numPatterns, commonParams.patternWeights,
+        data[0]._wave, randomDouble);
+    for (size_t i = 0; i < models.size(); ++i) {
+      updateSelectedPattern(commonParams, data[i], result.minIndex, pattern);
+      models[i]->propagate(data[i]);
+    }
+  }
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include <wfc/algorithm.h>
+#include <wfc/ranges.h>
+#include <wfc/tile_model.h>
+
+#include "test_helpers.h"
+
+// Knot-like tile set. "dead" only has "empty" next to it on one side, so
+// each of its rotations has some direction in which nothing fits.
+TileModelConfig knotConfig(bool periodic) {
+  Tile tile(4, RGBA{0, 0, 0, 255});
+  std::vector<CopiedTile> copiedTiles{{"empty", Symmetry::X, tile, 1.0},
+                                      {"line", Symmetry::I, tile, 1.0},
+                                      {"corner", Symmetry::L, tile, 0.5},
+                                      {"cross", Symmetry::X, tile, 0.2},
+                                      {"dead", Symmetry::L, tile, 1.0}};
+  std::vector<Neighbors> neighbors{
+      {{"empty", 0}, {"empty", 0}},  {{"empty", 0}, {"line", 1}},
+      {{"line", 0}, {"line", 0}},    {{"line", 0}, {"corner", 1}},
+      {{"corner", 0}, {"corner", 1}}, {{"corner", 1}, {"empty", 0}},
+      {{"cross", 0}, {"line", 0}},   {{"cross", 0}, {"cross", 0}},
+      {{"dead", 0}, {"empty", 0}}};
+  return {2, {}, false, {}, copiedTiles, neighbors, {{12, 10}, periodic}};
+}
+
+// Makes the same observations with both engines and checks that propagation
+// leaves the same wave after every step.
+void expectSameTileWaves(const TileModelInternal &internal, unsigned seed) {
+  auto factoryFcn = [&](PropagationEngine engine) {
+    return std::make_shared<TileModel>(internal, engine);
+  };
+  expectSameWaves(
+      internal.mCommonParams,
+      makeModels(factoryFcn, {PropagationEngine::kRescan,
+                              PropagationEngine::kSupportCounters}),
+      seed);
+}
+
+TEST(TilePropagationTest, unsupportedTileIsRemoved) {
+  TileModelInternal internal = fromConfig(knotConfig(true));
+  TileModel model(internal);
+  AlgorithmData algorithmData = model.initAlgorithmData();
+
+  size_t numRemoved = 0;
+  Index2D index{3, 4};
+  for (size_t t = 0; t < internal.mCommonParams.numPatterns; ++t) {
+    for (size_t d = 0; d < 4; ++d) {
+      if (internal._compatible[{d, t}].empty()) {
+        EXPECT_FALSE(algorithmData._wave.get(index, t)) << "tile " << t;
+        ++numRemoved;
+        break;
+      }
+    }
+  }
+  EXPECT_GT(numRemoved, 0);
+}
+
+TEST(TilePropagationTest, enginesAgreePeriodic) {
+  TileModelInternal internal = fromConfig(knotConfig(true));
+  for (unsigned seed = 0; seed < 3; ++seed) {
+    expectSameTileWaves(internal, seed);
+  }
+}
+
+TEST(TilePropagationTest, enginesAgreeNonPeriodic) {
+  TileModelInternal internal = fromConfig(knotConfig(false));
+  for (unsigned seed = 0; seed < 3; ++seed) {
+    expectSameTileWaves(internal, seed);
+  }
+}
+
+TEST(StripPartitionTest, stripsNearARow) {
+  StripPartition strips(10, 4);
+  EXPECT_EQ(strips.owner(0), 0u);
+  EXPECT_EQ(strips.owner(9), 3u);
+
+  auto nearFcn = [&](size_t y, size_t reach) {
+    std::vector<size_t> toReturn;
+    strips.forEachStripNear(y, reach, strips.owner(y),
+                            [&](size_t s) { toReturn.push_back(s); });
+    return toReturn;
+  };
+  // Rows 0-2, 3-4, 5-7 and 8-9
+  EXPECT_EQ(nearFcn(6, 1), std::vector<size_t>{});
+  EXPECT_EQ(nearFcn(4, 1), std::vector<size_t>{2});
+  // Wrapping around, each strip once
+  EXPECT_EQ(nearFcn(0, 1), std::vector<size_t>{3});
+  EXPECT_EQ(nearFcn(9, 2), (std::vector<size_t>{0, 2}));
+  EXPECT_EQ(nearFcn(1, 5), (std::vector<size_t>{1, 2, 3}));
+
+  // Never more strips than rows
+  EXPECT_EQ(StripPartition(3, 8).numStrips(), 3u);
+}
+
+// Propagates the same observations on one thread and on strips of 2 and 3
+// threads, and checks they reach the same wave and counters after every step,
+// and that the threads book the same entropies whatever their number.
+void expectSameParallelWaves(const TileModelInternal &internal,
+                             unsigned seed) {
+  // The models keep a reference to their internal
+  std::vector<TileModelInternal> internals(3, internal);
+  std::vector<std::shared_ptr<const Model>> models;
+  for (size_t i = 0; i < internals.size(); ++i) {
+    internals[i].parallelPropagation = {i + 1, 1};
+    models.push_back(std::make_shared<TileModel>(
+        internals[i], PropagationEngine::kSupportCounters));
+  }
+
+  auto checkFcn = [](const std::vector<AlgorithmData> &data, int step) {
+    for (size_t i = 1; i < data.size(); ++i) {
+      ASSERT_TRUE(data[0]._supportCounts == data[i]._supportCounts)
+          << "threads " << i + 1 << ", step " << step;
+      runForDimension(data[0]._wave.size(), [&](const Index2D &index) {
+        EXPECT_EQ(data[0]._entropies[index].numPossible,
+                  data[i]._entropies[index].numPossible);
+        // Only the threaded runs sum the entropies in the same order
+        if (i > 1) {
+          EXPECT_EQ(data[1]._entropies[index].entropy,
+                    data[i]._entropies[index].entropy);
+        }
+      });
+    }
+  };
+  expectSameWaves(internal.mCommonParams, models, seed, checkFcn);
+}
+
+TEST(TilePropagationTest, parallelMatchesSingleThread) {
+  for (bool periodic : {true, false}) {
+    TileModelConfig config = knotConfig(periodic);
+    config.commonParam.dimensions = {20, 16};
+    TileModelInternal internal = fromConfig(config);
+    for (unsigned seed = 0; seed < 3; ++seed) {
+      expectSameParallelWaves(internal, seed);
+    }
+  }
+}
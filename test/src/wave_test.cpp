@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <wfc/wave.h>
+
+#include <thread>
+#include <vector>
+
+TEST(WaveTest, startsFull) {
+  // 70 patterns spill into a second word per cell
+  Wave wave({3, 2}, 70, true);
+
+  ASSERT_EQ(wave.wordsPerCell(), 2u);
+  for (size_t y = 0; y < 2; ++y) {
+    for (size_t x = 0; x < 3; ++x) {
+      ASSERT_EQ(wave.count({x, y}), 70u);
+      ASSERT_TRUE(wave.get({x, y}, 69));
+    }
+  }
+}
+
+TEST(WaveTest, clearOnlyTouchesOneCell) {
+  Wave wave({3, 2}, 70, true);
+
+  ASSERT_TRUE(wave.clear({1, 1}, 65));
+  ASSERT_FALSE(wave.clear({1, 1}, 65));
+
+  ASSERT_FALSE(wave.get({1, 1}, 65));
+  ASSERT_TRUE(wave.get({0, 1}, 65));
+  ASSERT_TRUE(wave.get({2, 1}, 65));
+  ASSERT_EQ(wave.count({1, 1}), 69u);
+}
+
+TEST(WaveTest, forEachPattern) {
+  Wave wave({1, 1}, 130, false);
+  wave.set({0, 0, 3}, true);
+  wave.set({0, 0, 64}, true);
+  wave.set({0, 0, 129}, true);
+
+  std::vector<size_t> patterns;
+  wave.forEachPattern({0, 0}, [&](size_t t) { patterns.push_back(t); });
+
+  ASSERT_EQ(patterns, (std::vector<size_t>{3, 64, 129}));
+}
+
+TEST(WaveTest, intersects) {
+  Wave wave({1, 1}, 100, false);
+  wave.set({0, 0, 80}, true);
+
+  std::vector<WaveWord> mask(wave.wordsPerCell(), 0);
+  mask[0] = ~WaveWord(0);
+  ASSERT_FALSE(wave.intersects({0, 0}, mask.data()));
+
+  mask[1] = WaveWord(1) << (80 - 64);
+  ASSERT_TRUE(wave.intersects({0, 0}, mask.data()));
+}
+
+TEST(WaveTest, concurrentClearWord) {
+  Wave wave({2, 1}, 70, true);
+  ConcurrentWave concurrentWave(wave);
+
+  EXPECT_EQ(concurrentWave.clearWord({1, 0}, 1, 0b1011), WaveWord(0b1011));
+  EXPECT_EQ(concurrentWave.clearWord({1, 0}, 1, 0b0110), WaveWord(0b0100));
+
+  // Past the last pattern there is nothing to remove
+  EXPECT_EQ(concurrentWave.clearWord({1, 0}, 1, WaveWord(1) << 6), 0u);
+  EXPECT_FALSE(concurrentWave.clear({1, 0}, 65));
+  EXPECT_TRUE(concurrentWave.clear({1, 0}, 68));
+  EXPECT_FALSE(concurrentWave.get({1, 0}, 68));
+  EXPECT_EQ(concurrentWave.count({1, 0}), 65u);
+}
+
+TEST(WaveTest, racingClearsRemoveEachPatternOnce) {
+  Wave wave({4, 3}, 130, true);
+  ConcurrentWave concurrentWave(wave);
+  const size_t numThreads = 4;
+
+  // Every thread tries to remove every pattern, starting at a different one
+  std::vector<size_t> removed(numThreads, 0);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < numThreads; ++i) {
+    threads.emplace_back([&, i]() {
+      for (size_t j = 0; j < 130; ++j) {
+        size_t t = (j + 40 * i) % 130;
+        for (size_t y = 0; y < 3; ++y) {
+          for (size_t x = 0; x < 4; ++x) {
+            removed[i] += concurrentWave.clear({x, y}, t);
+          }
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  size_t sum = 0;
+  for (size_t count : removed) {
+    sum += count;
+  }
+  EXPECT_EQ(sum, 4u * 3u * 130u);
+  EXPECT_TRUE(wave == Wave({4, 3}, 130, false));
+}